@@ -0,0 +1,759 @@
+/*
+ * Allocator benchmark harness used to measure what ASan costs
+ * allocation-heavy code: the same binary is built with and without
+ * -fsanitize=address and run under different ASAN_OPTIONS (see run.sh).
+ *
+ * Workloads follow bench_syscalls: a setup/op/teardown triple run by every
+ * thread, every op timed individually for the latency percentiles.  After the
+ * timed loops the harness samples VmRSS, which under ASan includes the
+ * quarantine, so the rss_kb column shows what quarantine_size_mb and
+ * thread_local_quarantine_size_kb cost in memory while ops/s and p99 show
+ * what they cost in time.  Every run (workload and thread count) gets a
+ * fresh process, so that rss_kb doesn't include the heap and the quarantine
+ * that earlier runs left behind.
+ *
+ *   churn       replace a random object of a live set of -l small objects
+ *   xthread     allocate, hand the block to the next thread over a ring and
+ *               free one handed over by the previous thread
+ *   realloc     grow a 4 KB block by half its size up to -m, then free it
+ *   fragment    like churn with mixed sizes from 16 bytes to 64 KB
+ *   quarantine  allocate and free 16 blocks of 1 to 64 KB, about 512 KB of
+ *               frees per op, which keeps the quarantine recycling
+ *
+ * In sweep mode (-s N) every workload is run at 1..N threads and the scaling
+ * efficiency ops(n) / (n * ops(1)) is reported, as in bench_syscalls.
+ *
+ * Build:
+ *   gcc -O2 -pthread -o bench_malloc bench_malloc.c
+ *   gcc -O2 -pthread -fsanitize=address -o bench_malloc_asan bench_malloc.c
+ * Use:
+ *   ./bench_malloc -w churn,xthread -t 8 -n 4096 -r 5 -f csv
+ *   ASAN_OPTIONS=quarantine_size_mb=0 ./bench_malloc_asan -w quarantine -s 8
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RING_SIZE 1024
+#define QUARANTINE_BATCH 16
+
+/* Single producer, single consumer: ring i is fed by thread i - 1. */
+struct ring {
+	void *slot[RING_SIZE];
+	unsigned head __attribute__((aligned(64)));
+	unsigned tail __attribute__((aligned(64)));
+};
+
+struct thread_ctx {
+	int id;
+	uint64_t rnd;
+	void **objs;		/* live set of churn and fragment */
+	size_t *sizes;
+	uint64_t *lat;		/* nreps * niters per-op latencies, ns */
+	uint64_t *elapsed;	/* nreps per-repetition run times, ns */
+	long vol_csw;		/* context switches during the timed loops */
+	long invol_csw;
+};
+
+struct result {
+	double ops_per_sec;
+	uint64_t median_ns;
+	uint64_t p99_ns;
+	long rss_kb;
+	long vol_csw;
+	long invol_csw;
+};
+
+struct workload {
+	const char *name;
+	void (*setup)(struct thread_ctx *ctx);
+	void (*op)(struct thread_ctx *ctx);
+	void (*teardown)(struct thread_ctx *ctx);
+};
+
+static int nthreads = 1;
+static int sweep_max;
+static int sweep_step = 1;
+static long niters = 4096;
+static int nreps = 5;
+static long nwarmup = 256;
+static int pin_threads;
+static int csv_output;
+static FILE *status_log;
+
+static long live_objs = 4096;
+static size_t realloc_max = 1 << 20;
+
+static long page_size;
+static cpu_set_t allowed_cpus;
+static pthread_barrier_t barrier;
+static const struct workload *cur_workload;
+static int cur_nthreads;
+static struct ring *rings;
+static long cur_rss_kb;
+
+static void check(long result, const char *message)
+{
+	if (result < 0) {
+		perror(message);
+		exit(-1);
+	}
+}
+
+static void *xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if (!p) {
+		fprintf(stderr, "Out of memory\n");
+		exit(-1);
+	}
+	return p;
+}
+
+static void *xrealloc(void *p, size_t size)
+{
+	p = realloc(p, size);
+	if (!p) {
+		fprintf(stderr, "Out of memory\n");
+		exit(-1);
+	}
+	return p;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void pin_to_cpu(int id)
+{
+	cpu_set_t set;
+	int n = id % CPU_COUNT(&allowed_cpus);
+	int cpu;
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, &allowed_cpus))
+			continue;
+		if (n-- == 0)
+			break;
+	}
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	errno = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	check(errno ? -1 : 0, "Couldn't pin thread");
+}
+
+/* Accepts an optional K, M or G suffix. */
+static size_t parse_size(const char *arg)
+{
+	char *end;
+	size_t size = strtoul(arg, &end, 0);
+
+	switch (*end) {
+	case 'G':
+		size <<= 10;
+		/* fall through */
+	case 'M':
+		size <<= 10;
+		/* fall through */
+	case 'K':
+		size <<= 10;
+		end++;
+	}
+	return *end ? 0 : size;
+}
+
+/* xorshift64, every thread has its own sequence. */
+static uint64_t next_rand(struct thread_ctx *ctx)
+{
+	ctx->rnd ^= ctx->rnd << 13;
+	ctx->rnd ^= ctx->rnd >> 7;
+	ctx->rnd ^= ctx->rnd << 17;
+	return ctx->rnd;
+}
+
+static size_t rand_size(struct thread_ctx *ctx, size_t lo, size_t hi)
+{
+	return lo + next_rand(ctx) % (hi - lo + 1);
+}
+
+/*
+ * Write the block the way its user would initialize it: small blocks
+ * entirely, large ones a byte per page so that page faults are counted but
+ * don't dominate.
+ */
+static void touch(char *p, size_t size)
+{
+	size_t i;
+
+	if (size <= (size_t)page_size) {
+		memset(p, 'a', size);
+		return;
+	}
+	for (i = 0; i < size; i += page_size)
+		p[i] = 'a';
+	p[size - 1] = 'a';
+}
+
+static int ring_push(struct ring *r, void *p)
+{
+	unsigned tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+
+	if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == RING_SIZE)
+		return 0;
+	r->slot[tail % RING_SIZE] = p;
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+static void *ring_pop(struct ring *r)
+{
+	unsigned head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	void *p;
+
+	if (head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))
+		return NULL;
+	p = r->slot[head % RING_SIZE];
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+	return p;
+}
+
+static void nop_setup(struct thread_ctx *ctx)
+{
+}
+
+static size_t churn_size(struct thread_ctx *ctx)
+{
+	return rand_size(ctx, 1, 16) * 16;
+}
+
+/*
+ * Mostly small objects with a tail of large ones, so that freed holes of
+ * every size class get refilled by whatever size comes next.
+ */
+static size_t fragment_size(struct thread_ctx *ctx)
+{
+	unsigned pick = next_rand(ctx) % 100;
+
+	if (pick < 70)
+		return rand_size(ctx, 16, 128);
+	if (pick < 95)
+		return rand_size(ctx, 129, 4096);
+	return rand_size(ctx, 4097, 65536);
+}
+
+static void fill_live_set(struct thread_ctx *ctx,
+			  size_t (*size_fn)(struct thread_ctx *ctx))
+{
+	long i;
+
+	ctx->objs = xmalloc(sizeof(*ctx->objs) * live_objs);
+	ctx->sizes = xmalloc(sizeof(*ctx->sizes) * live_objs);
+	for (i = 0; i < live_objs; i++) {
+		ctx->sizes[i] = size_fn(ctx);
+		ctx->objs[i] = xmalloc(ctx->sizes[i]);
+		touch(ctx->objs[i], ctx->sizes[i]);
+	}
+}
+
+static void replace_live(struct thread_ctx *ctx,
+			 size_t (*size_fn)(struct thread_ctx *ctx))
+{
+	long i = next_rand(ctx) % live_objs;
+
+	free(ctx->objs[i]);
+	ctx->sizes[i] = size_fn(ctx);
+	ctx->objs[i] = xmalloc(ctx->sizes[i]);
+	touch(ctx->objs[i], ctx->sizes[i]);
+}
+
+static void live_set_teardown(struct thread_ctx *ctx)
+{
+	long i;
+
+	for (i = 0; i < live_objs; i++)
+		free(ctx->objs[i]);
+	free(ctx->sizes);
+	free(ctx->objs);
+}
+
+static void churn_setup(struct thread_ctx *ctx)
+{
+	fill_live_set(ctx, churn_size);
+}
+
+static void churn_op(struct thread_ctx *ctx)
+{
+	replace_live(ctx, churn_size);
+}
+
+static void fragment_setup(struct thread_ctx *ctx)
+{
+	fill_live_set(ctx, fragment_size);
+}
+
+static void fragment_op(struct thread_ctx *ctx)
+{
+	replace_live(ctx, fragment_size);
+}
+
+/*
+ * When the next thread falls behind and the ring is full, the block is freed
+ * locally rather than waiting: a thread that has finished its ops would
+ * never drain it.  With one thread the ring leads back to itself.
+ */
+static void xthread_op(struct thread_ctx *ctx)
+{
+	size_t size = rand_size(ctx, 32, 512);
+	char *p = xmalloc(size);
+
+	touch(p, size);
+	if (!ring_push(&rings[(ctx->id + 1) % cur_nthreads], p))
+		free(p);
+	free(ring_pop(&rings[ctx->id]));
+}
+
+/* Runs once every thread is done pushing, see bench_thread. */
+static void xthread_teardown(struct thread_ctx *ctx)
+{
+	void *p;
+
+	while ((p = ring_pop(&rings[ctx->id])))
+		free(p);
+}
+
+static void realloc_op(struct thread_ctx *ctx)
+{
+	size_t size = 4096, new_size;
+	char *p = xmalloc(size);
+
+	touch(p, size);
+	while (size < realloc_max) {
+		new_size = size + size / 2;
+		if (new_size > realloc_max)
+			new_size = realloc_max;
+		p = xrealloc(p, new_size);
+		touch(p + size, new_size - size);
+		size = new_size;
+	}
+	free(p);
+}
+
+static void quarantine_op(struct thread_ctx *ctx)
+{
+	char *blocks[QUARANTINE_BATCH];
+	size_t size;
+	int i;
+
+	for (i = 0; i < QUARANTINE_BATCH; i++) {
+		size = rand_size(ctx, 1024, 65536);
+		blocks[i] = xmalloc(size);
+		touch(blocks[i], size);
+	}
+	for (i = 0; i < QUARANTINE_BATCH; i++)
+		free(blocks[i]);
+}
+
+static const struct workload workloads[] = {
+	{ "churn",	churn_setup,	churn_op,	live_set_teardown },
+	{ "xthread",	nop_setup,	xthread_op,	xthread_teardown },
+	{ "realloc",	nop_setup,	realloc_op,	nop_setup },
+	{ "fragment",	fragment_setup,	fragment_op,	live_set_teardown },
+	{ "quarantine",	nop_setup,	quarantine_op,	nop_setup },
+};
+
+#define NWORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+static const struct workload *find_workload(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < NWORKLOADS; i++)
+		if (!strcmp(workloads[i].name, name))
+			return &workloads[i];
+	return NULL;
+}
+
+/* Resident set in KB, from VmRSS in /proc/self/status. */
+static long read_rss_kb(void)
+{
+	char line[256];
+	long rss = -1;
+	FILE *status;
+
+	status = fopen("/proc/self/status", "r");
+	if (!status)
+		check(-1, "Couldn't open /proc/self/status");
+	while (fgets(line, sizeof(line), status))
+		if (sscanf(line, "VmRSS: %ld", &rss) == 1)
+			break;
+	fclose(status);
+	return rss;
+}
+
+static void *bench_thread(void *arg)
+{
+	struct thread_ctx *ctx = arg;
+	const struct workload *w = cur_workload;
+	struct rusage before, after;
+	uint64_t start;
+	uint64_t *lat;
+	long i;
+	int rep;
+
+	if (pin_threads)
+		pin_to_cpu(ctx->id);
+	w->setup(ctx);
+	for (i = 0; i < nwarmup; i++)
+		w->op(ctx);
+	for (rep = 0; rep < nreps; rep++) {
+		check(getrusage(RUSAGE_THREAD, &before), "getrusage failed");
+		lat = ctx->lat + rep * niters;
+		pthread_barrier_wait(&barrier);
+		ctx->elapsed[rep] = 0;
+		for (i = 0; i < niters; i++) {
+			start = now_ns();
+			w->op(ctx);
+			lat[i] = now_ns() - start;
+			ctx->elapsed[rep] += lat[i];
+		}
+		check(getrusage(RUSAGE_THREAD, &after), "getrusage failed");
+		ctx->vol_csw += after.ru_nvcsw - before.ru_nvcsw;
+		ctx->invol_csw += after.ru_nivcsw - before.ru_nivcsw;
+	}
+	/*
+	 * Sample RSS with every live set still allocated, then tear down only
+	 * once nobody allocates or pushes to a ring anymore.
+	 */
+	pthread_barrier_wait(&barrier);
+	if (ctx->id == 0)
+		cur_rss_kb = read_rss_kb();
+	pthread_barrier_wait(&barrier);
+	w->teardown(ctx);
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static uint64_t percentile(const uint64_t *sorted, size_t n, int pct)
+{
+	size_t idx = (n * pct + 99) / 100;
+
+	return sorted[idx ? idx - 1 : 0];
+}
+
+/* Append /proc/self/status once the workload threads have been joined. */
+static void log_proc_status(const struct workload *w, int n)
+{
+	char buf[4096];
+	size_t len;
+	FILE *status;
+
+	if (!status_log)
+		return;
+	status = fopen("/proc/self/status", "r");
+	if (!status)
+		check(-1, "Couldn't open /proc/self/status");
+	fprintf(status_log, "# %s threads=%d\n", w->name, n);
+	while ((len = fread(buf, 1, sizeof(buf), status)) > 0)
+		fwrite(buf, 1, len, status_log);
+	fclose(status);
+	fflush(status_log);
+}
+
+static void run_workload(const struct workload *w, int n, struct result *res)
+{
+	struct thread_ctx *ctxs;
+	pthread_t *threads;
+	uint64_t *all_lat;
+	double *rates;
+	size_t nlat = (size_t)nreps * niters;
+	int i, rep, rc;
+
+	cur_workload = w;
+	cur_nthreads = n;
+	ctxs = calloc(n, sizeof(*ctxs));
+	threads = xmalloc(sizeof(*threads) * n);
+	if (!ctxs)
+		check(-1, "calloc failed");
+	errno = posix_memalign((void **)&rings, 64, sizeof(*rings) * n);
+	check(errno ? -1 : 0, "Couldn't allocate rings");
+	memset(rings, 0, sizeof(*rings) * n);
+	pthread_barrier_init(&barrier, NULL, n);
+	for (i = 0; i < n; i++) {
+		ctxs[i].id = i;
+		ctxs[i].rnd = 0x9e3779b97f4a7c15ull * (i + 1);
+		ctxs[i].lat = xmalloc(sizeof(uint64_t) * nlat);
+		ctxs[i].elapsed = xmalloc(sizeof(uint64_t) * nreps);
+		rc = pthread_create(&threads[i], NULL, bench_thread, &ctxs[i]);
+		if (rc) {
+			printf("Couldn't start thread. error %d\n", rc);
+			exit(-1);
+		}
+	}
+	for (i = 0; i < n; i++) {
+		rc = pthread_join(threads[i], NULL);
+		if (rc) {
+			printf("Couldn't join thread. error %d\n", rc);
+			exit(-1);
+		}
+	}
+	pthread_barrier_destroy(&barrier);
+	log_proc_status(w, n);
+	res->rss_kb = cur_rss_kb;
+
+	/* A repetition lasts as long as its slowest thread's timed ops. */
+	rates = xmalloc(sizeof(double) * nreps);
+	for (rep = 0; rep < nreps; rep++) {
+		uint64_t slowest = 1;
+
+		for (i = 0; i < n; i++)
+			if (ctxs[i].elapsed[rep] > slowest)
+				slowest = ctxs[i].elapsed[rep];
+		rates[rep] = (double)n * niters * 1e9 / slowest;
+	}
+	qsort(rates, nreps, sizeof(double), cmp_double);
+	res->ops_per_sec = rates[nreps / 2];
+
+	all_lat = xmalloc(sizeof(uint64_t) * nlat * n);
+	res->vol_csw = res->invol_csw = 0;
+	for (i = 0; i < n; i++) {
+		memcpy(all_lat + i * nlat, ctxs[i].lat, sizeof(uint64_t) * nlat);
+		res->vol_csw += ctxs[i].vol_csw;
+		res->invol_csw += ctxs[i].invol_csw;
+	}
+	qsort(all_lat, nlat * n, sizeof(uint64_t), cmp_u64);
+	res->median_ns = percentile(all_lat, nlat * n, 50);
+	res->p99_ns = percentile(all_lat, nlat * n, 99);
+
+	for (i = 0; i < n; i++) {
+		free(ctxs[i].lat);
+		free(ctxs[i].elapsed);
+	}
+	free(all_lat);
+	free(rates);
+	free(rings);
+	free(threads);
+	free(ctxs);
+}
+
+/*
+ * run_workload in a child process: neither the RSS nor the allocator state of
+ * one run carries over to the next.
+ */
+static void run_isolated(const struct workload *w, int n, struct result *res)
+{
+	int fds[2], status;
+	pid_t pid;
+
+	check(pipe(fds), "Couldn't open pipe");
+	/* The child must not write what is buffered a second time. */
+	fflush(NULL);
+	pid = fork();
+	check(pid, "fork failed");
+	if (pid == 0) {
+		close(fds[0]);
+		run_workload(w, n, res);
+		if (write(fds[1], res, sizeof(*res)) != sizeof(*res))
+			_exit(1);
+		_exit(0);
+	}
+	close(fds[1]);
+	if (read(fds[0], res, sizeof(*res)) != sizeof(*res)) {
+		fprintf(stderr, "%s with %d threads failed\n", w->name, n);
+		exit(-1);
+	}
+	close(fds[0]);
+	check(waitpid(pid, &status, 0), "waitpid failed");
+}
+
+/* Efficiency is only known in sweep mode; a negative value omits it. */
+static void print_result(const struct workload *w, int n,
+			 const struct result *res, double efficiency)
+{
+	if (csv_output) {
+		printf("%s,%d,%d,%ld,%.0f,%llu,%llu,", w->name, n, nreps,
+		       niters, res->ops_per_sec,
+		       (unsigned long long)res->median_ns,
+		       (unsigned long long)res->p99_ns);
+		if (efficiency >= 0)
+			printf("%.3f", efficiency);
+		printf(",%ld,%ld,%ld\n", res->rss_kb, res->vol_csw,
+		       res->invol_csw);
+	} else {
+		printf("%-10s threads=%d ops/s=%.0f median=%lluns p99=%lluns",
+		       w->name, n, res->ops_per_sec,
+		       (unsigned long long)res->median_ns,
+		       (unsigned long long)res->p99_ns);
+		if (efficiency >= 0)
+			printf(" eff=%.3f", efficiency);
+		printf(" rss=%ldKB csw=%ld/%ld\n", res->rss_kb, res->vol_csw,
+		       res->invol_csw);
+	}
+	fflush(stdout);
+}
+
+static void sweep_workload(const struct workload *w)
+{
+	struct result base, res;
+	int n;
+
+	run_isolated(w, 1, &base);
+	print_result(w, 1, &base, 1.0);
+	for (n = sweep_step > 1 ? sweep_step : 2; n <= sweep_max;
+	     n += sweep_step) {
+		run_isolated(w, n, &res);
+		print_result(w, n, &res, res.ops_per_sec / (n * base.ops_per_sec));
+	}
+}
+
+static void usage(const char *prog)
+{
+	size_t i;
+
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -w LIST  comma-separated workloads, or \"all\" (default)\n"
+		"  -t N     threads (default %d)\n"
+		"  -n N     timed ops per thread per repetition (default %ld)\n"
+		"  -r N     repetitions (default %d)\n"
+		"  -W N     untimed warm-up ops per thread (default %ld)\n"
+		"  -s N     sweep thread counts from 1 to N instead of using -t\n"
+		"  -S N     thread count increment for -s (default %d)\n"
+		"  -P FILE  append /proc/self/status to FILE after every run\n"
+		"  -p       pin thread i to the i-th allowed CPU\n"
+		"  -l N     live objects per thread for churn and fragment "
+		"(default %ld)\n"
+		"  -m SIZE  final size of realloc, K/M/G suffixes allowed "
+		"(default %zu)\n"
+		"  -f FMT   output format: text or csv\n"
+		"Workloads:",
+		prog, nthreads, niters, nreps, nwarmup, sweep_step, live_objs,
+		realloc_max);
+	for (i = 0; i < NWORKLOADS; i++)
+		fprintf(stderr, " %s", workloads[i].name);
+	fprintf(stderr, "\n");
+	exit(-1);
+}
+
+int main(int argc, char **argv)
+{
+	const struct workload *selected[NWORKLOADS];
+	char *list = "all";
+	char *name;
+	size_t nselected = 0;
+	size_t i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "w:t:n:r:W:s:S:P:pl:m:f:")) != -1) {
+		switch (opt) {
+		case 'w':
+			list = optarg;
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 'n':
+			niters = atol(optarg);
+			break;
+		case 'r':
+			nreps = atoi(optarg);
+			break;
+		case 'W':
+			nwarmup = atol(optarg);
+			break;
+		case 's':
+			sweep_max = atoi(optarg);
+			break;
+		case 'S':
+			sweep_step = atoi(optarg);
+			break;
+		case 'P':
+			status_log = fopen(optarg, "a");
+			if (!status_log)
+				check(-1, "Couldn't open status log");
+			break;
+		case 'p':
+			pin_threads = 1;
+			break;
+		case 'l':
+			live_objs = atol(optarg);
+			break;
+		case 'm':
+			realloc_max = parse_size(optarg);
+			break;
+		case 'f':
+			if (!strcmp(optarg, "csv"))
+				csv_output = 1;
+			else if (strcmp(optarg, "text"))
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nthreads < 1 || niters < 1 || nreps < 1 || nwarmup < 0 ||
+	    sweep_max < 0 || sweep_step < 1 || live_objs < 1 ||
+	    realloc_max < 4096)
+		usage(argv[0]);
+
+	if (!strcmp(list, "all")) {
+		for (i = 0; i < NWORKLOADS; i++)
+			selected[nselected++] = &workloads[i];
+	} else {
+		for (name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+			if (nselected == NWORKLOADS)
+				usage(argv[0]);
+			selected[nselected] = find_workload(name);
+			if (!selected[nselected++]) {
+				fprintf(stderr, "Unknown workload %s\n", name);
+				usage(argv[0]);
+			}
+		}
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+	check(sched_getaffinity(0, sizeof(allowed_cpus), &allowed_cpus),
+	      "sched_getaffinity failed");
+
+	if (csv_output)
+		printf("workload,threads,reps,iters,ops_per_sec,median_ns,"
+		       "p99_ns,efficiency,rss_kb,vol_csw,invol_csw\n");
+	for (i = 0; i < nselected; i++) {
+		struct result res;
+
+		if (sweep_max) {
+			sweep_workload(selected[i]);
+			continue;
+		}
+		run_isolated(selected[i], nthreads, &res);
+		print_result(selected[i], nthreads, &res, -1);
+	}
+	return 0;
+}
@@ -0,0 +1,95 @@
+#!/bin/bash
+# Measures what ASan costs allocation-heavy code: bench_malloc built without
+# ASan and with it, the latter under several ASAN_OPTIONS. See README.txt.
+# $ ./run.sh
+# CC       the compiler, must support -fsanitize=address (default clang)
+# CONFIGS  configurations to run, NAME=ASAN_OPTIONS separated by spaces;
+#          native is the build without ASan and is always run first
+#          (default: asan with the default options, then quarantine_size_mb
+#          at 0 and 4 times the default, thread_local_quarantine_size_kb at
+#          1/16 and 4 times the default)
+# THREADS  the workloads are swept from 1 thread to THREADS
+#          (default: the CPUs, at most 8)
+# ITERS    timed ops per thread per repetition (default 4096)
+# REPS     repetitions, the median rate is kept (default 5)
+# OUT      where the builds, logs, results.csv and table.txt go
+#          (default malloc-out)
+
+me=$(basename $0)
+SRC=$(cd $(dirname $0) && pwd)
+CC=${CC:-clang}
+CONFIGS=${CONFIGS:-"asan=
+  q0=quarantine_size_mb=0
+  q1024=quarantine_size_mb=1024
+  tlq64=thread_local_quarantine_size_kb=64
+  tlq4096=thread_local_quarantine_size_kb=4096"}
+THREADS=${THREADS:-$(n=$(nproc); echo $((n < 8 ? n : 8)))}
+ITERS=${ITERS:-4096}
+REPS=${REPS:-5}
+OUT=${OUT:-malloc-out}
+
+rm -rf $OUT
+mkdir -p $OUT/logs
+OUT=$(cd $OUT && pwd)
+
+CFLAGS="-std=gnu99 -O2 -g -pthread"
+$CC $CFLAGS $SRC/bench_malloc.c -o $OUT/bench_malloc &&
+$CC $CFLAGS -fsanitize=address $SRC/bench_malloc.c \
+  -o $OUT/bench_malloc_asan || exit 1
+
+# 1, THREADS/2 and THREADS threads.
+STEP=$((THREADS / 2 > 1 ? THREADS / 2 : 1))
+BENCH_ARGS="-s $THREADS -S $STEP -n $ITERS -r $REPS -f csv"
+
+# results.csv: the rows of every configuration's csv, prefixed with its name.
+echo "config,workload,threads,reps,iters,ops_per_sec,median_ns,p99_ns,\
+efficiency,rss_kb,vol_csw,invol_csw" > $OUT/results.csv
+for config in native $CONFIGS; do
+  name=${config%%=*}
+  echo "$me: $name"
+  log=$OUT/logs/$name
+  if [ $name = native ]; then
+    $OUT/bench_malloc $BENCH_ARGS > $log.csv 2> $log.err
+  else
+    ASAN_OPTIONS=${config#*=} $OUT/bench_malloc_asan $BENCH_ARGS \
+      > $log.csv 2> $log.err
+  fi
+  if [ $? != 0 ]; then
+    echo >&2 "$me: $name failed, see $log.err"
+    continue
+  fi
+  awk -v c=$name 'NR > 1 { print c "," $0 }' $log.csv >> $OUT/results.csv
+done
+
+# The table compares every configuration with native at the same thread
+# count: throughput, p99 latency and RSS.
+awk -F, '
+  NR == 1 { next }
+  {
+    key = $2 "," $3
+    if (!($1 in seen_config)) { seen_config[$1] = 1; configs[++nc] = $1 }
+    if (!(key in seen_key)) { seen_key[key] = 1; keys[++nk] = key }
+    rate[$1, key] = $6; p99[$1, key] = $8; rss[$1, key] = $10
+    eff[$1, key] = $9
+  }
+  function ratio(x, base) { return base > 0 ? sprintf("%.2f", x / base) : "-" }
+  END {
+    printf "%-10s %-10s %7s %12s %9s %10s %9s %9s %7s %6s\n", "config",
+           "workload", "threads", "ops_per_sec", "slowdown", "p99_ns",
+           "p99_x", "rss_kb", "rss_x", "eff"
+    for (c = 1; c <= nc; c++) {
+      n = configs[c]
+      for (k = 1; k <= nk; k++) {
+        key = keys[k]
+        if (!((n, key) in rate))
+          continue
+        split(key, f, ",")
+        printf "%-10s %-10s %7d %12.0f %9s %10.0f %9s %9.0f %7s %6s\n",
+               n, f[1], f[2], rate[n, key],
+               ratio(rate["native", key], rate[n, key]),
+               p99[n, key], ratio(p99[n, key], p99["native", key]),
+               rss[n, key], ratio(rss[n, key], rss["native", key]),
+               eff[n, key]
+      }
+    }
+  }' $OUT/results.csv | tee $OUT/table.txt
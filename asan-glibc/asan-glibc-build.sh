@@ -8,6 +8,9 @@ ASAN_BUILD=$HERE/asan-build
 ASAN_INST=$HERE/asan-inst
 ASAN_LIBS=$HERE/asan-libs
 PATH=$HOME/toolchains/gcc-trunk/bin:$PATH
+# Per-object instrumentation levels, see asan-glibc-gcc-wrapper.py.
+# gen_policy writes one from a perf profile of a workload.
+export ASAN_GLIBC_POLICY=${ASAN_GLIBC_POLICY:-}
 
 # Debian
 configure_flags="--prefix=/usr --without-cvs --enable-add-ons=libidn,nptl --without-selinux --enable-stackguard-randomization --enable-obsolete-rpc"
@@ -67,6 +70,13 @@ build_asan() {
   cd $HERE
 }
 
+# gen_policy perf.data: leave the glibc objects that are hot in perf.data
+# uninstrumented (or only check their writes). Needs a finished $ASAN_BUILD;
+# rebuild with ASAN_GLIBC_POLICY=$HERE/asan-glibc-policy.txt afterwards.
+gen_policy() {
+  python $HERE/asan-glibc-gen-policy.py $1 $ASAN_BUILD > $HERE/asan-glibc-policy.txt
+}
+
 test_asan() {
   clang -c asan-glibc-test.c
   clang asan-glibc-test.o  \
@@ -78,6 +88,10 @@ test_asan() {
    ./asan_glibc_test  1 2      2>&1 | grep getenv || echo 'FAIL'
    ./asan_glibc_test  1 2 3    2>&1 | grep nss_hostname_digits_dots || echo 'FAIL'
    ./asan_glibc_test  1 2 3 4  2>&1 | grep internal_fnmatch || echo 'FAIL'
+   ./asan_glibc_test  1 2 3 4 5  2>&1 | grep strstr || echo 'FAIL'
+   # No false positives from the over-reads of the SSE4.2 kernels.
+   ./asan_glibc_test  1 2 3 4 5 6  2>&1 | grep 'strcspn: 0' || echo 'FAIL'
+   ./asan_glibc_test  1 2 3 4 5 6 7  2>&1 | grep strspn || echo 'FAIL'
 
 }
 
@@ -12,26 +12,71 @@ blacklist=['rtld', '/dl-', 'elf/', 'string/mem', 'time/time',
            'time/gettimeofday', 'time/timegm', 'time/timespec_get',
            'nptl/libc_pthread_init', 'nptl/register-atfork', 'string/strstr',
            'string/strcasestr',
+           ]
+
+# Routines that read 16-aligned data outside of their buffers, e.g.
 #0 0x7f5147637bd9 in _mm_load_si128 .../x86_64-unknown-linux-gnu/5.0.0/include/emmintrin.h:688
 #1 0x7f5147637bd9 in __strcspn_sse42 .../glibc-2.19/string/../sysdeps/x86_64/multiarch/strcspn-c.c:123
-           'string/strcspn-c',  # May read 16-aligned data outside of buffer.
-           'string/strpbrk-c',  # Same function as strcspn
-           'string/strspn-c',  # Same.
-           'string/wordcopy',  # Same.
-           ]
+# are built from simd/<object>.c instead, which checks the extent of their
+# buffers once per call. See simd/asan-glibc-simd.h. These take precedence
+# over the blacklist and the policy.
+SIMD_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'simd')
+
+# Instrumentation levels of the policy file, with the flags they add on top
+# of -fsanitize=address.
+LEVELS = {
+  'full': [],
+  'reads-only': ['--param', 'asan-instrument-writes=0'],
+  'writes-only': ['--param', 'asan-instrument-reads=0'],
+  'off': None,
+}
+
+# $ASAN_GLIBC_POLICY names a file of "<level> <object regex>" lines, e.g.
+#   off          string/strlen$
+#   writes-only  malloc/
+# The first line whose regex matches the object (string/strlen for
+# .../build/string/strlen.os) decides; objects matching no line get 'full'.
+# The blacklist above always wins. asan-glibc-gen-policy.py generates such a
+# file from a perf profile.
+def LoadPolicy():
+  path = os.getenv('ASAN_GLIBC_POLICY')
+  if not path:
+    return []
+  policy = []
+  for line in open(path):
+    line = line.split('#', 1)[0].split()
+    if not line:
+      continue
+    if len(line) != 2 or line[0] not in LEVELS:
+      sys.exit('%s: bad policy line: %s' % (path, ' '.join(line)))
+    policy.append((line[0], line[1]))
+  return policy
+
+def SimdOverride(out_file):
+  match = re.match(r'/.*build/(.*).os$', out_file)
+  if not match:
+    return None
+  path = os.path.join(SIMD_DIR, match.group(1) + '.c')
+  if not os.path.exists(path):
+    return None
+  return path
 
-def AllowAsan(out_file):
+# Returns the instrumentation level of out_file.
+def AsanLevel(out_file):
   match = re.match(r'/.*build/(.*).os$', out_file)
   if not match:
     #print >>sys.stderr, 'FALLBACK_NO_MATCH: %s' % out_file
-    return False
+    return 'off'
   obj = match.group(1)
 
   for b in blacklist:
     if re.search(b, obj):
       #print >>sys.stderr, 'FALLBACK_BLACKLIST: %s' % obj
-      return False
-  return True
+      return 'off'
+  for level, regex in LoadPolicy():
+    if re.search(regex, obj):
+      return level
+  return 'full'
 
 def o():
   try:
@@ -93,9 +138,19 @@ if __name__ == '__main__':
   args = sys.argv[1:]
   args = [arg for arg in args if arg != '-Wl,-z,defs']
 
-  if AllowAsan(o()):
-    print >> sys.stderr, 'ASAN:', o()
+  level = AsanLevel(o())
+  override = SimdOverride(o())
+  sources = [arg for arg in args if arg.endswith('.c')]
+  if override and len(sources) == 1:
+    print >> sys.stderr, 'ASAN (simd):', o()
+    args[args.index(sources[0])] = override
+    args.append('-DASAN_GLIBC_SOURCE="%s"' % os.path.abspath(sources[0]))
+    # The override checks the buffers itself, the kernel stays as it is.
+    level = 'off'
+  if level != 'off':
+    print >> sys.stderr, 'ASAN (%s):' % level, o()
     args.append('-fsanitize=address')
+    args.extend(LEVELS[level])
     # Temporarily disable UAR. See comment asan-init-stub.c
     args.append('--param')
     args.append('asan-use-after-return=0')
@@ -0,0 +1,95 @@
+#!/usr/bin/env python
+# Generates an instrumentation policy for asan-glibc-gcc-wrapper.py from a
+# perf profile of a reference workload:
+#   perf record -o perf.data -- <workload running against asan-inst>
+#   ./asan-glibc-gen-policy.py perf.data asan-build > policy.txt
+#   ASAN_GLIBC_POLICY=$(pwd)/policy.txt ./asan-glibc-build.sh
+# The samples of the glibc functions are summed up per object file of the
+# build (found with nm), and every object is given a level by its share of
+# all samples: 'off' from --off percent up, 'writes-only' (read checks are
+# the bulk of the overhead) from --writes-only percent up. Everything else
+# keeps full instrumentation.
+import optparse
+import os
+import re
+import subprocess
+import sys
+
+# "  12.34%  libc-2.19.so  [.] __strlen_sse2"
+REPORT_RE = re.compile(r'^\s*([\d.]+)%\s+(\S+)\s+\[\.\]\s+(\S+)')
+NM_RE = re.compile(r'^[0-9a-f]* *[TtWiu] (\S+)$')
+
+def ReadProfile(perf_data, dso_regex):
+  output = subprocess.check_output(
+      ['perf', 'report', '-i', perf_data, '--stdio', '--no-children',
+       '--sort', 'dso,sym', '-g', 'none'])
+  profile = {}
+  for line in output.splitlines():
+    match = REPORT_RE.match(line)
+    if match and re.search(dso_regex, match.group(2)):
+      sym = match.group(3)
+      profile[sym] = profile.get(sym, 0) + float(match.group(1))
+  return profile
+
+# Maps every function defined in the build to its object, named the way the
+# wrapper names it (string/strlen for <build>/string/strlen.os).
+def FunctionObjects(build_dir):
+  objects = []
+  for root, dirs, files in os.walk(build_dir):
+    objects += [os.path.join(root, f) for f in files if f.endswith('.os')]
+  functions = {}
+  # nm prints "\n<file>:\n" before the symbols of each of its arguments.
+  for i in range(0, len(objects), 500):
+    output = subprocess.check_output(['nm', '--defined-only'] +
+                                     objects[i:i + 500])
+    obj = None
+    for line in output.splitlines():
+      if line.endswith('.os:'):
+        obj = os.path.relpath(line[:-len('.os:')], build_dir)
+        continue
+      match = NM_RE.match(line)
+      if match and obj:
+        functions.setdefault(match.group(1), obj)
+  return functions
+
+def main():
+  parser = optparse.OptionParser(
+      usage='%prog [options] perf.data glibc-build-dir > policy.txt')
+  parser.add_option('--off', type='float', default=2.0, metavar='PERCENT',
+                    help='leave objects this hot uninstrumented [%default]')
+  parser.add_option('--writes-only', type='float', default=0.5,
+                    metavar='PERCENT',
+                    help='only check writes in objects this hot [%default]')
+  parser.add_option('--dso', default=r'^(lib[a-z_]+|ld)-[\d.]+\.so$',
+                    metavar='REGEX',
+                    help='DSOs of the profile that are glibc [%default]')
+  options, args = parser.parse_args()
+  if len(args) != 2:
+    parser.error('expected perf.data and the glibc build directory')
+
+  profile = ReadProfile(args[0], options.dso)
+  functions = FunctionObjects(args[1])
+  per_object = {}
+  for sym, percent in profile.items():
+    obj = functions.get(sym)
+    if obj is None:
+      print >> sys.stderr, 'not in the build: %s (%.2f%%)' % (sym, percent)
+      continue
+    total, syms = per_object.get(obj, (0, []))
+    per_object[obj] = (total + percent, syms + [sym])
+
+  print '# Generated by %s from %s' % (os.path.basename(sys.argv[0]), args[0])
+  for obj, (percent, syms) in sorted(per_object.items(),
+                                     key=lambda item: -item[1][0]):
+    if percent >= options.off:
+      level = 'off'
+    elif percent >= options.writes_only:
+      level = 'writes-only'
+    else:
+      break
+    regex = '^%s$' % obj.replace('.', r'\.').replace('+', r'\+')
+    print '%-12s %s  # %.2f%% %s' % (level, regex, percent,
+                                     ' '.join(sorted(syms)))
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,16 @@
+/* ASan-aware versions of the glibc string routines that load whole aligned
+ * vectors or words and thus read past the end of their buffers.
+ *
+ * asan-glibc-gcc-wrapper.py compiles simd/<object>.c instead of the glibc
+ * source of <object>, without -fsanitize=address, and passes the path of
+ * the original source in ASAN_GLIBC_SOURCE.  Each file renames the routine,
+ * includes the original and defines a routine of the original name that
+ * calls it and checks the logical extent of every buffer with one
+ * __asan_loadN/__asan_storeN call.  The kernels keep their full speed and
+ * over-reads of the aligned loads stay unreported.
+ */
+
+#include <stddef.h>
+
+extern void __asan_loadN (const void *, size_t);
+extern void __asan_storeN (void *, size_t);
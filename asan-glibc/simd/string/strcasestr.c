@@ -0,0 +1,19 @@
+/* strcasestr with SSE4.2 intrinsics, checked with ASan.  */
+
+#define __strcasestr_sse42 __asan_unchecked_strcasestr_sse42
+#include ASAN_GLIBC_SOURCE
+#undef __strcasestr_sse42
+
+#include "../asan-glibc-simd.h"
+
+char *
+__strcasestr_sse42 (const unsigned char *s1, const unsigned char *s2)
+{
+  char *p = __asan_unchecked_strcasestr_sse42 (s1, s2);
+  size_t n2 = strlen ((const char *) s2);
+  /* A match is not looked at past its end.  */
+  __asan_loadN (s1, p ? (size_t) (p - (const char *) s1) + n2
+                      : strlen ((const char *) s1) + 1);
+  __asan_loadN (s2, n2 + 1);
+  return p;
+}
@@ -0,0 +1,17 @@
+/* strcspn with SSE4.2 intrinsics, checked with ASan.  */
+
+#define __strcspn_sse42 __asan_unchecked_strcspn_sse42
+#include ASAN_GLIBC_SOURCE
+#undef __strcspn_sse42
+
+#include "../asan-glibc-simd.h"
+
+size_t
+__strcspn_sse42 (const char *s, const char *a)
+{
+  size_t n = __asan_unchecked_strcspn_sse42 (s, a);
+  /* s[n] is either the terminator or the first rejected character.  */
+  __asan_loadN (s, n + 1);
+  __asan_loadN (a, strlen (a) + 1);
+  return n;
+}
@@ -0,0 +1,16 @@
+/* strpbrk with SSE4.2 intrinsics, checked with ASan.  */
+
+#define __strpbrk_sse42 __asan_unchecked_strpbrk_sse42
+#include ASAN_GLIBC_SOURCE
+#undef __strpbrk_sse42
+
+#include "../asan-glibc-simd.h"
+
+char *
+__strpbrk_sse42 (const char *s, const char *a)
+{
+  char *p = __asan_unchecked_strpbrk_sse42 (s, a);
+  __asan_loadN (s, (p ? (size_t) (p - s) : strlen (s)) + 1);
+  __asan_loadN (a, strlen (a) + 1);
+  return p;
+}
@@ -0,0 +1,17 @@
+/* strspn with SSE4.2 intrinsics, checked with ASan.  */
+
+#define __strspn_sse42 __asan_unchecked_strspn_sse42
+#include ASAN_GLIBC_SOURCE
+#undef __strspn_sse42
+
+#include "../asan-glibc-simd.h"
+
+size_t
+__strspn_sse42 (const char *s, const char *a)
+{
+  size_t n = __asan_unchecked_strspn_sse42 (s, a);
+  /* s[n] is either the terminator or the first character not in a.  */
+  __asan_loadN (s, n + 1);
+  __asan_loadN (a, strlen (a) + 1);
+  return n;
+}
@@ -0,0 +1,56 @@
+/* _wordcopy_* of memcopy.h, checked with ASan.  The *_dest_aligned
+   variants read whole aligned words around an unaligned source.  LEN is
+   in words; the backward variants get pointers to the ends.  */
+
+#define _wordcopy_fwd_aligned __asan_unchecked_wordcopy_fwd_aligned
+#define _wordcopy_fwd_dest_aligned __asan_unchecked_wordcopy_fwd_dest_aligned
+#define _wordcopy_bwd_aligned __asan_unchecked_wordcopy_bwd_aligned
+#define _wordcopy_bwd_dest_aligned __asan_unchecked_wordcopy_bwd_dest_aligned
+#include ASAN_GLIBC_SOURCE
+#undef _wordcopy_fwd_aligned
+#undef _wordcopy_fwd_dest_aligned
+#undef _wordcopy_bwd_aligned
+#undef _wordcopy_bwd_dest_aligned
+
+#include "../asan-glibc-simd.h"
+
+static void
+check_fwd (long int dstp, long int srcp, size_t len)
+{
+  __asan_loadN ((const void *) srcp, len * OPSIZ);
+  __asan_storeN ((void *) dstp, len * OPSIZ);
+}
+
+static void
+check_bwd (long int dstp, long int srcp, size_t len)
+{
+  check_fwd (dstp - len * OPSIZ, srcp - len * OPSIZ, len);
+}
+
+void
+_wordcopy_fwd_aligned (long int dstp, long int srcp, size_t len)
+{
+  check_fwd (dstp, srcp, len);
+  __asan_unchecked_wordcopy_fwd_aligned (dstp, srcp, len);
+}
+
+void
+_wordcopy_fwd_dest_aligned (long int dstp, long int srcp, size_t len)
+{
+  check_fwd (dstp, srcp, len);
+  __asan_unchecked_wordcopy_fwd_dest_aligned (dstp, srcp, len);
+}
+
+void
+_wordcopy_bwd_aligned (long int dstp, long int srcp, size_t len)
+{
+  check_bwd (dstp, srcp, len);
+  __asan_unchecked_wordcopy_bwd_aligned (dstp, srcp, len);
+}
+
+void
+_wordcopy_bwd_dest_aligned (long int dstp, long int srcp, size_t len)
+{
+  check_bwd (dstp, srcp, len);
+  __asan_unchecked_wordcopy_bwd_dest_aligned (dstp, srcp, len);
+}
@@ -16,6 +16,7 @@ CLANG_BUILD=$ROOT/clang_build
 SPEC_DIRNAME=SPEC_CPU2006v1.2
 SPEC_SRC="${ROOT}/${SPEC_DIRNAME}"
 SPEC_RUNNER=./run_spec_clang_asan.sh
+SPEC_MATRIX=./run_spec_asan_matrix.sh
 #SPEC_TESTS='perlbench bzip2'
 SPEC_TESTS='perlbench bzip2 gcc mcf gobmk hmmer sjeng libquantum h264ref omnetpp astar xalancbmk'
 
@@ -71,6 +72,14 @@ if [ ! -e $SPEC_SRC/$SPEC_RUNNER ]; then
   chmod a+x $SPEC_RUNNER
   )
 fi
+
+if [ ! -e $SPEC_SRC/$SPEC_MATRIX ]; then
+  (
+  cd $SPEC_SRC
+  wget https://address-sanitizer.googlecode.com/svn/trunk/spec/run_spec_asan_matrix.sh
+  chmod a+x $SPEC_MATRIX
+  )
+fi
 )
 
 export ASAN_BIN=$CLANG_BUILD/bin
@@ -91,3 +100,13 @@ do
     perf report
   )
 done
+
+echo @@@BUILD_STEP asan overhead matrix@@@
+(
+  set +x
+  cd $SPEC_SRC
+  OUT=asan-matrix $SPEC_MATRIX test $SPEC_TESTS
+  awk '$2 == "asan" || $2 == "asan-leaks" {
+    printf "@@@STEP_TEXT@%s %s %sx cpu %sx mem@@@\n", $1, $2, $4, $6
+  }' asan-matrix/table.txt
+)
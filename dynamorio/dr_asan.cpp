@@ -20,7 +20,12 @@
 #include <dr_api.h>
 #include <drutil.h>
 
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include <algorithm>
+#include <map>
 #include <string>
 #include <set>
 #include <vector>
@@ -65,6 +70,9 @@ ptr_int_t kShadowOffset;
 struct AsanCallbacks {
   typedef void (*Report)(void*);
   Report report[2 /* load/store */][5 /* 1,2,4,8,16 */];
+  // __asan_report_error(pc, bp, sp, addr, is_write, size, exp), for -recover.
+  typedef void (*ReportError)(void*, void*, void*, void*, int, size_t, uint);
+  ReportError report_error;
 };
 
 class ModuleData {
@@ -80,9 +88,132 @@ class ModuleData {
   string path_;
   bool should_instrument_;
   bool should_use_rough_reads_;
+  // Which accesses get checked, see -check and -check_module.
+  bool check_reads_;
+  bool check_writes_;
+  // Calls shared check routines rather than inlining them, see
+  // -shared_checks.
+  bool use_shared_checks_;
   bool executed_;
 };
 
+// Which accesses to check, set with -check MODE (all modules) and
+// -check_module MODE:SUBSTRING (modules whose path contains SUBSTRING, the
+// first match wins). MODE is all, writes or reads.
+struct CheckMode {
+  bool reads;
+  bool writes;
+};
+
+struct ModuleCheckMode {
+  string substring;
+  CheckMode mode;
+};
+
+CheckMode g_check_mode = { true, true };
+std::vector<ModuleCheckMode> g_module_check_modes;
+// -instrument_module SUBSTRING: also instrument the modules outside /lib and
+// /usr/lib whose path contains SUBSTRING.
+std::vector<string> g_instrument_modules;
+
+// -check_stack: also check XSP/XBP-relative operands, except for constant
+// offsets from XSP below -frame_size, which are assumed to address the
+// current frame. -check_tls: also check FS/GS-relative operands.
+bool g_check_stack = false;
+bool g_check_tls = false;
+int g_frame_size = 4096;
+// -stats: print how many memory operands of each kind the instrumented code
+// has.
+bool g_print_stats = false;
+// -traces: instrument traces as a whole and hoist the checks of counted
+// loops to their entry, see event_trace. Needs DR's traces to be on.
+bool g_use_traces = false;
+// -shared_checks: modules at least this many MB big call shared check
+// routines instead of inlining the checks, see BuildSharedChecks. -1 if off.
+int g_shared_checks_mb = -1;
+// -recover: report through __asan_report_error and go on, see
+// InsertRecoverableReport. The first failure of each app PC is reported, the
+// others are only counted.
+bool g_recover = false;
+// The app PCs that have reported, by ReportRecoverable when they first fail,
+// with the repeats that g_report_slots didn't count.
+std::map<app_pc, uint> *g_reported_pcs;
+void *g_reported_pcs_lock;
+// A direct-mapped cache of g_reported_pcs by the low bits of the PC, so that
+// the trap code can count a repeat without a clean call. A slot is taken by
+// the first reported PC that maps to it; the PCs that collide with it go
+// through ReportRecoverable every time, which still reports them only once.
+struct ReportSlot {
+  app_pc pc;
+  uint repeats;
+};
+const uint kNumReportSlots = 1 << 16;
+ReportSlot *g_report_slots;
+
+// Processes that are only run for their children, see dr_init. -skip_app NAME
+// adds to the list, -instrument_app NAME takes a name off it.
+const char *const kDefaultSkipApps[] = {
+  "python", "python2.7", "ps", "env", "rm", "sed", "grep", "basename",
+  "bash", "sh", "cat", "touch", "mkdir", "cut", "gawk", "dbus-launch",
+  "mktemp", "chmod", "true", "exit", "yes", "echo",
+};
+std::vector<string> g_skip_apps(
+    kDefaultSkipApps,
+    kDefaultSkipApps + sizeof(kDefaultSkipApps) / sizeof(kDefaultSkipApps[0]));
+
+enum OperandKind {
+  OPERAND_SKIP,
+  OPERAND_PLAIN,  // base+index+disp not involving XSP/XBP or a segment.
+  OPERAND_STACK,
+  OPERAND_FRAME,  // Constant offset from XSP, never checked.
+  OPERAND_TLS,
+  NUM_OPERAND_KINDS
+};
+
+// Static counts, per instrumented memory operand. Racy, like executed_.
+uint g_operand_stats[NUM_OPERAND_KINDS];
+uint g_hoisted_operands;
+
+// A loop trace: a trace whose only conditional branch is a final
+// "cmp B, E; jne <trace head>", in which B is advanced by a constant stride
+// exactly once and E is never written. Once entered, such a loop runs all of
+// its (E - B) / stride iterations, so the operands based on B (and nothing
+// else) touch a range that is known at entry and is checked there, see
+// ValidateLoop.
+struct LoopInfo {
+  ptr_int_t stride;
+  // Bounds of the bytes accessed through B in one iteration, relative to the
+  // value B has at the trace head. Operands after the update of B see it
+  // already advanced by stride.
+  ptr_int_t min_disp;
+  ptr_int_t max_end;
+  // What LOOP_TLS_OWNER holds for this loop, small enough for a displacement.
+  int id;
+};
+
+// Raw TLS slots of -traces, read and written by the instrumentation.
+enum LoopTlsSlot {
+  // The LoopInfo::id of the loop that last ran ValidateLoop on this thread.
+  LOOP_TLS_OWNER,
+  // Iterations left of the loop execution it validated.
+  LOOP_TLS_BUDGET,
+  // Non-zero if the range of that execution is addressable, in which case
+  // the hoisted checks are skipped.
+  LOOP_TLS_CHECKED,
+  NUM_LOOP_TLS_SLOTS
+};
+
+reg_id_t g_loop_tls_segment;
+uint g_loop_tls_offset;
+
+// The LoopInfos of the loop traces, by the app PC of the trace head. A trace
+// that is built again, to translate it or after a flush, gets back the
+// LoopInfo of the same loop, so there is one per loop and not one per build.
+// They are freed with their module, see event_module_unload.
+typedef std::multimap<app_pc, LoopInfo *> LoopInfoMap;
+LoopInfoMap *g_loop_infos;
+void *g_loop_infos_lock;
+
 // TODO: on Windows, we may have multiple RTLs in one process.
 AsanCallbacks g_callbacks = {0};
 
@@ -100,6 +231,9 @@ ModuleData::ModuleData()
     path_(""),
     should_instrument_(false),
     should_use_rough_reads_(false),
+    check_reads_(false),
+    check_writes_(false),
+    use_shared_checks_(false),
     executed_(false)
 {}
 
@@ -110,9 +244,112 @@ ModuleData::ModuleData(const module_data_t *info)
     // We'll check the black/white lists later and adjust these.
     should_instrument_(true),
     should_use_rough_reads_(false),
+    check_reads_(true),
+    check_writes_(true),
+    use_shared_checks_(false),
     executed_(false)
 {}
 
+bool ParseCheckMode(const string &name, CheckMode *mode) {
+  if (name == "all") {
+    mode->reads = mode->writes = true;
+  } else if (name == "writes") {
+    mode->reads = false;
+    mode->writes = true;
+  } else if (name == "reads") {
+    mode->reads = true;
+    mode->writes = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void UsageError(const string &message) {
+  dr_fprintf(STDERR, "==DRASAN== %s\n"
+             "Options: -check all|writes|reads\n"
+             "         -check_module all|writes|reads:SUBSTRING\n"
+             "         -check_stack -frame_size N -check_tls -traces -stats\n"
+             "         -shared_checks MB -instrument_module SUBSTRING\n"
+             "         -skip_app NAME -instrument_app NAME -recover\n",
+             message.c_str());
+  dr_abort();
+}
+
+// Client options are the words between the client path and "--" on the
+// drrun command line.
+void ParseOptions(client_id_t id) {
+  std::vector<string> words;
+  const char *options = dr_get_options(id);
+  string word;
+  for (const char *c = options; c && *c; c++) {
+    if (*c != ' ') {
+      word += *c;
+    } else if (!word.empty()) {
+      words.push_back(word);
+      word.clear();
+    }
+  }
+  if (!word.empty())
+    words.push_back(word);
+
+  for (size_t i = 0; i < words.size(); i++) {
+    const string &name = words[i];
+    if (name == "-check_stack") {
+      g_check_stack = true;
+      continue;
+    } else if (name == "-check_tls") {
+      g_check_tls = true;
+      continue;
+    } else if (name == "-traces") {
+      g_use_traces = true;
+      continue;
+    } else if (name == "-stats") {
+      g_print_stats = true;
+      continue;
+    } else if (name == "-recover") {
+      g_recover = true;
+      continue;
+    }
+    if (i + 1 == words.size())
+      UsageError("Missing value for " + name);
+    const string &value = words[++i];
+    if (name == "-check") {
+      if (!ParseCheckMode(value, &g_check_mode))
+        UsageError("Bad -check " + value);
+    } else if (name == "-instrument_module") {
+      g_instrument_modules.push_back(value);
+    } else if (name == "-skip_app") {
+      g_skip_apps.push_back(value);
+    } else if (name == "-instrument_app") {
+      g_skip_apps.erase(std::remove(g_skip_apps.begin(), g_skip_apps.end(),
+                                    value),
+                        g_skip_apps.end());
+    } else if (name == "-shared_checks") {
+      g_shared_checks_mb = atoi(value.c_str());
+      if (g_shared_checks_mb < 0)
+        UsageError("Bad -shared_checks " + value);
+    } else if (name == "-frame_size") {
+      g_frame_size = atoi(value.c_str());
+      if (g_frame_size < 0)
+        UsageError("Bad -frame_size " + value);
+    } else if (name == "-check_module") {
+      size_t colon = value.find(':');
+      ModuleCheckMode module_mode;
+      if (colon == string::npos ||
+          !ParseCheckMode(value.substr(0, colon), &module_mode.mode))
+        UsageError("Bad -check_module " + value);
+      module_mode.substring = value.substr(colon + 1);
+      g_module_check_modes.push_back(module_mode);
+    } else {
+      UsageError("Unknown option " + name);
+    }
+  }
+  // The shared report stubs can't return to the check site.
+  if (g_recover && g_shared_checks_mb >= 0)
+    UsageError("-recover doesn't work with -shared_checks");
+}
+
 void InitializeAsanCallbacks() {
   static bool initialized = false;
   CHECK(!initialized);
@@ -130,11 +367,36 @@ void InitializeAsanCallbacks() {
   // could change in the future if DR gets early injection. Just to be safe, we
   // call __asan_init, which is a nop if it's already initialized. We also use
   // this pointer to detect modules that use asan instrumentation.
-  void (*app_asan_init)(void);
-  if (app_asan_init = dr_get_proc_address(app->handle, "__asan_init_v3")) {
+  // Which runtime it is also tells where the shadow is. The __asan_init of
+  // 2012 has it at 1 << 44 on x86_64, the __asan_init_vN that followed at
+  // 0x7fff8000. Since LLVM 3.8 __asan_init is unversioned again, with the
+  // 0x7fff8000 shadow and __asan_version_mismatch_check_vN next to it; only
+  // these runtimes honour halt_on_error in __asan_report_error.
+  static const char *const kVersionChecks[] = {
+    "__asan_version_mismatch_check_v8", "__asan_version_mismatch_check_v7",
+    "__asan_version_mismatch_check_v6",
+  };
+  static const char *const kVersionedInits[] = {
+    "__asan_init_v5", "__asan_init_v4", "__asan_init_v3",
+  };
+  bool recoverable_runtime = false;
+  for (size_t i = 0; i < sizeof(kVersionChecks) / sizeof(kVersionChecks[0]);
+       i++) {
+    if (dr_get_proc_address(app->handle, kVersionChecks[i]) != NULL)
+      recoverable_runtime = true;
+  }
+  void (*app_asan_init)(void) = NULL;
+  for (size_t i = 0; i < sizeof(kVersionedInits) / sizeof(kVersionedInits[0]) &&
+       app_asan_init == NULL; i++) {
+    app_asan_init = dr_get_proc_address(app->handle, kVersionedInits[i]);
+  }
+  if (app_asan_init != NULL) {
     kShadowOffset = IF_X64_ELSE(0x00007fff8000, 0x20000000);
   } else if (app_asan_init = dr_get_proc_address(app->handle, "__asan_init")) {
-    kShadowOffset = IF_X64_ELSE(1ull << 44, 1 << 29);
+    if (recoverable_runtime)
+      kShadowOffset = IF_X64_ELSE(0x00007fff8000, 0x20000000);
+    else
+      kShadowOffset = IF_X64_ELSE(1ull << 44, 1 << 29);
   } else {
     dr_fprintf(STDERR, "FATAL: Couldn't find __asan_init* in the application"
                " binary! (%s)\nAre you sure it's instrumented by ASan?\n",
@@ -145,6 +407,12 @@ void InitializeAsanCallbacks() {
   dr_switch_to_app_state(dc);
   app_asan_init();
   dr_switch_to_dr_state(dc);
+  // Runtimes that export it say where the shadow really is, e.g. when it is
+  // mapped dynamically.
+  ptr_int_t *dynamic_shadow = (ptr_int_t *)dr_get_proc_address(
+      app->handle, "__asan_shadow_memory_dynamic_address");
+  if (dynamic_shadow != NULL)
+    kShadowOffset = *dynamic_shadow;
 
   if (dr_get_proc_address(app->handle, "__asan_address_is_poisoned") == NULL) {
     // Special case: we do want to instrument the main binary if it is not
@@ -181,30 +449,82 @@ void InitializeAsanCallbacks() {
           (AsanCallbacks::Report)(report_func);
     }
   }
+  if (g_recover) {
+    // Every runtime exports __asan_report_error, the older ones just die in
+    // it.
+    if (!recoverable_runtime) {
+      dr_fprintf(STDERR, "FATAL: -recover needs an ASan runtime from LLVM 3.8"
+                 " or later (with __asan_version_mismatch_check_v6 or later),"
+                 " the one of %s dies at the first error\n", app->full_path);
+      dr_abort();
+    }
+    g_callbacks.report_error = (AsanCallbacks::ReportError)
+        dr_get_proc_address(app->handle, "__asan_report_error");
+    if (g_callbacks.report_error == NULL) {
+      dr_fprintf(STDERR, "FATAL: -recover needs __asan_report_error, which %s"
+                 " doesn't export\n", app->full_path);
+      dr_abort();
+    }
+  }
 
   dr_free_module_data(app);
 }
 
-// Currently, we are only interested in base+index+displacement memory operands
-// that don't use XSP or XBP as the base.  These are most likely to be involved
-// in buggy pointer arithmetic in the application.
+// By default, we are only interested in base+index+displacement memory
+// operands that don't use XSP or XBP as the base.  These are most likely to be
+// involved in buggy pointer arithmetic in the application.
 // timurrrr: wait a sec, what about accessing local variables on the stack via
 // XBP+offset? On one hand, we don't insert redzones around them in the
 // hybrid-instrumented code; on the other we still want to report OOBs/UARs on
 // stack-var-passed-to-the-other-threads.
+// -check_stack covers those. A constant offset from XSP (push, pop, call,
+// ret, spills and most locals) can only hit the current frame or the red zone
+// below it, so these are left alone; indexed XSP accesses and everything
+// XBP-relative get checked. With -fomit-frame-pointer XBP is just another
+// pointer anyway.
 //
 // TODO: Handle absolute addresses and PC-relative addresses.  These are
 // unlikely to have bugs because they are most likely generated by the compiler
 // to access globals or the GOT, but we have seen cases involving ODR and two
 // globals with different types at the same address in ASan.
-// TODO: Handle TLS accesses via FS or GS.  DR assumes all other segments have a
-// zero base anyway.
-bool OperandIsInteresting(opnd_t opnd) {
+// -check_tls covers FS/GS accesses; the segment base is added by
+// drutil_insert_get_mem_addr.  DR assumes all other segments have a zero base
+// anyway.
+OperandKind ClassifyOperand(opnd_t opnd) {
   // TOTHINK: we may access waaaay beyound the stack, do we need to check it?
-  return (opnd_is_base_disp(opnd) &&
-          opnd_get_segment(opnd) == DR_REG_NULL &&
-          !opnd_uses_reg(opnd, DR_REG_XSP) &&
-          !opnd_uses_reg(opnd, DR_REG_XBP));
+  if (!opnd_is_base_disp(opnd))
+    return OPERAND_SKIP;
+  if (opnd_get_segment(opnd) != DR_REG_NULL)
+    return g_check_tls ? OPERAND_TLS : OPERAND_SKIP;
+  if (!opnd_uses_reg(opnd, DR_REG_XSP) && !opnd_uses_reg(opnd, DR_REG_XBP))
+    return OPERAND_PLAIN;
+  if (!g_check_stack)
+    return OPERAND_SKIP;
+  const int kRedZoneSize = IF_X64_ELSE(128, 0);
+  if (opnd_get_base(opnd) == DR_REG_XSP &&
+      opnd_get_index(opnd) == DR_REG_NULL &&
+      opnd_get_disp(opnd) >= -kRedZoneSize &&
+      opnd_get_disp(opnd) < g_frame_size)
+    return OPERAND_FRAME;
+  return OPERAND_STACK;
+}
+
+bool OperandIsInteresting(opnd_t opnd) {
+  OperandKind kind = ClassifyOperand(opnd);
+  return kind != OPERAND_SKIP && kind != OPERAND_FRAME;
+}
+
+void CountOperands(instr_t *instr) {
+  for (int s = 0; s < instr_num_srcs(instr); s++) {
+    opnd_t op = instr_get_src(instr, s);
+    if (opnd_is_memory_reference(op))
+      g_operand_stats[ClassifyOperand(op)]++;
+  }
+  for (int d = 0; d < instr_num_dsts(instr); d++) {
+    opnd_t op = instr_get_dst(instr, d);
+    if (opnd_is_memory_reference(op))
+      g_operand_stats[ClassifyOperand(op)]++;
+  }
 }
 
 bool WantToInstrument(instr_t *instr) {
@@ -248,98 +568,312 @@ enum AccessType {
   ROUGH_READ,
 };
 
-void InstrumentMops(void *drcontext, instrlist_t *bb,
-                    instr_t *i, opnd_t op, AccessType access_type)
-{
-  bool need_to_restore_eflags = false;
-  uint flags = instr_get_arith_flags(i);
-  // TODO: do something smarter with flags and spills in general?
-  // For example, spill them only once for a sequence of instrumented
-  // instructions that don't change/read flags.
-
-  if (!TESTALL(EFLAGS_WRITE_6, flags) || TESTANY(EFLAGS_READ_6, flags)) {
-#if defined(VERBOSE_VERBOSE)
-    dr_printf("Spilling eflags...\n");
+// Registers a shared check routine may get the address in (any R1 of
+// InstrumentMops) and use as a scratch (R2, one of the first four).
+const reg_id_t kSharedCheckRegs[] = {
+  DR_REG_XAX, DR_REG_XBX, DR_REG_XCX, DR_REG_XDX,
+#if __WORDSIZE == 64
+  DR_REG_R8, DR_REG_R9, DR_REG_R10, DR_REG_R11,
+  DR_REG_R12, DR_REG_R13, DR_REG_R14, DR_REG_R15,
 #endif
-    need_to_restore_eflags = true;
-    // TODO: Maybe sometimes don't need to 'seto'.
-    // TODO: Maybe sometimes don't want to spill XAX here?
-    // TODO: No need to spill XAX here if XAX is not used in the BB.
-    dr_save_reg(drcontext, bb, i, DR_REG_XAX, SPILL_SLOT_1);
-    dr_save_arith_flags_to_xax(drcontext, bb, i);
-    dr_save_reg(drcontext, bb, i, DR_REG_XAX, SPILL_SLOT_3);
-    dr_restore_reg(drcontext, bb, i, DR_REG_XAX, SPILL_SLOT_1);
+};
+const int kNumSharedCheckRegs =
+    sizeof(kSharedCheckRegs) / sizeof(kSharedCheckRegs[0]);
+
+// Entry points of the shared check routines, by access type, log2 of the
+// access size (up to 8 bytes, like the inline checks), R1 and R2.
+app_pc g_shared_checks[3][4][kNumSharedCheckRegs][4];
+uint g_shared_check_sites;
+
+int SharedCheckRegIndex(reg_id_t reg) {
+  for (int i = 0; i < kNumSharedCheckRegs; i++) {
+    if (kSharedCheckRegs[i] == reg)
+      return i;
   }
+  return -1;
+}
 
-#if 0
-  dr_printf("==DRASAN== DEBUG: %d %d %d %d %d %d\n",
-            opnd_is_memory_reference(op),
-            opnd_is_base_disp(op),
-            opnd_get_index(op),
-            opnd_is_far_memory_reference(op),
-            opnd_is_reg_pointer_sized(op),
-            opnd_is_base_disp(op) ? opnd_get_disp(op) : -1
-            );
+int AccessSizeIndex(opnd_t op) {
+  uint access_size = opnd_size_in_bytes(opnd_get_size(op));
+  int sz_idx = 0;
+  while (access_size > 1 && sz_idx < 3) {
+    sz_idx++;
+    access_size /= 2;
+  }
+  return sz_idx;
+}
+
+// Called from the report stub of a shared check with the bad address and the
+// return address of the call at the check site. Jumps to the right
+// __asan_report_* just like the inline trap code does: on an aligned stack,
+// with the app PC of the access as the return address.
+void ReportFromSharedCheck(ptr_uint_t addr, app_pc ret_addr, uint is_write,
+                           uint sz_idx) {
+  void *drcontext = dr_get_current_drcontext();
+  dr_mcontext_t mc;
+  mc.size = sizeof(mc);
+  mc.flags = DR_MC_ALL;
+  dr_get_mcontext(drcontext, &mc);
+  // The site's "call R2" is two bytes and translates to the access.
+  app_pc pc = dr_app_pc_from_cache_pc(ret_addr - 2);
+  mc.xsp &= ~(ptr_uint_t)15;
+#if __WORDSIZE == 32
+  mc.xsp -= 2 * sizeof(void *);
+  ((ptr_uint_t *)mc.xsp)[1] = addr;
+#else
+  mc.xsp -= sizeof(void *);
+# if WINDOWS
+  mc.xcx = addr;
+# else
+  mc.xdi = addr;
+# endif
 #endif
+  *(app_pc *)mc.xsp = pc;
+  mc.pc = (app_pc)g_callbacks.report[is_write][sz_idx];
+  dr_redirect_execution(&mc);
+}
 
-  reg_id_t R1;
-  bool address_in_R1 = false;
-  if (opnd_is_base_disp(op) && opnd_get_index(op) == DR_REG_NULL &&
-      opnd_get_disp(op) == 0) {
-    // If this is a simple access with no offset or index,
-    // we can try to just use the base for R1.
-    R1 = opnd_get_base(op);
+ReportSlot *GetReportSlot(app_pc pc) {
+  return &g_report_slots[(ptr_uint_t)pc & (kNumReportSlots - 1)];
+}
 
-    // Can only use R1 if it's down-size'able to 8 bytes.
-    // TODO(timurrrr): is there a handy helper function around?
-    switch (R1) {
-    case DR_REG_XAX: case DR_REG_XBX: case DR_REG_XCX: case DR_REG_XDX:
-#if __WORDSIZE == 64
-    case DR_REG_R8: case DR_REG_R9: case DR_REG_R10: case DR_REG_R11:
-    case DR_REG_R12: case DR_REG_R13: case DR_REG_R14: case DR_REG_R15:
-#endif
-      address_in_R1 = true;
+// Clean call of the -recover trap code, for a PC that has no slot of its own
+// yet. The app's stack and registers are untouched, so __asan_report_error
+// unwinds from the access itself, and returns unless halt_on_error is set.
+void ReportRecoverable(ptr_uint_t addr, app_pc pc, uint is_write,
+                       uint access_size) {
+  dr_mutex_lock(g_reported_pcs_lock);
+  std::map<app_pc, uint>::iterator it = g_reported_pcs->find(pc);
+  bool first = it == g_reported_pcs->end();
+  if (first) {
+    (*g_reported_pcs)[pc] = 0;
+    ReportSlot *slot = GetReportSlot(pc);
+    if (slot->pc == NULL)
+      slot->pc = pc;
+  } else {
+    it->second++;
+  }
+  dr_mutex_unlock(g_reported_pcs_lock);
+  if (!first)
+    return;
+  void *drcontext = dr_get_current_drcontext();
+  dr_mcontext_t mc;
+  mc.size = sizeof(mc);
+  mc.flags = DR_MC_INTEGER | DR_MC_CONTROL;
+  dr_get_mcontext(drcontext, &mc);
+  dr_switch_to_app_state(drcontext);
+  g_callbacks.report_error(pc, (void *)mc.xbp, (void *)mc.xsp, (void *)addr,
+                           is_write, access_size, 0);
+  dr_switch_to_dr_state(drcontext);
+}
+
+#define APPEND(what) instrlist_meta_append(ilist, INSTR_CREATE_##what);
+#define APPENDF(what) instrlist_meta_append(ilist, what);
+
+// The body of the inline checks, as a routine: called with the address in
+// R1, returns if the access is fine and goes to |report_stub| with the
+// address in SPILL_SLOT_4 otherwise. Clobbers R1, R2 and the flags, which the
+// call site saves.
+void AppendSharedCheck(void *drcontext, instrlist_t *ilist,
+                       AccessType access_type, int sz_idx,
+                       reg_id_t R1, reg_id_t R2, app_pc report_stub) {
+  uint access_size = 1 << sz_idx;
+  reg_id_t R1_8 = reg_32_to_opsz(IF_X64_ELSE(reg_64_to_32(R1), R1), OPSZ_1),
+           R2_8 = reg_resize_to_opsz(R2, OPSZ_1);
+  instr_t *OK_label = INSTR_CREATE_label(drcontext);
+
+  APPEND(mov_ld(drcontext, opnd_create_reg(R2), opnd_create_reg(R1)));
+  APPEND(shr(drcontext, opnd_create_reg(R2), OPND_CREATE_INT8(3)));
+  if (kShadowOffset == (int)kShadowOffset) {
+    APPEND(add(drcontext, opnd_create_reg(R2),
+               OPND_CREATE_INT32(kShadowOffset)));
+  } else {
+    dr_save_reg(drcontext, ilist, NULL, R1, SPILL_SLOT_4);
+    APPEND(mov_imm(drcontext, opnd_create_reg(R1),
+                   OPND_CREATE_INTPTR(kShadowOffset)));
+    APPEND(add(drcontext, opnd_create_reg(R2), opnd_create_reg(R1)));
+    dr_restore_reg(drcontext, ilist, NULL, R1, SPILL_SLOT_4);
+  }
+  if (access_type == ROUGH_READ) {
+    APPEND(cmp(drcontext, OPND_CREATE_MEM8(R2,0), OPND_CREATE_INT8(8)));
+    APPEND(jcc(drcontext, OP_jb_short, opnd_create_instr(OK_label)));
+  } else {
+    APPEND(cmp(drcontext, OPND_CREATE_MEM8(R2,0), OPND_CREATE_INT8(0)));
+    APPEND(jcc(drcontext, OP_je_short, opnd_create_instr(OK_label)));
+  }
+  dr_save_reg(drcontext, ilist, NULL, R1, SPILL_SLOT_4);
+  if (access_size < 8 && access_type != ROUGH_READ) {
+    // Unlike the inline check, only the shadow byte is loaded again.
+    APPEND(mov_ld(drcontext, opnd_create_reg(R2_8), OPND_CREATE_MEM8(R2,0)));
+    APPEND(and(drcontext, opnd_create_reg(R1), OPND_CREATE_INT8(7)));
+    if (access_size > 1) {
+      APPEND(add(drcontext, opnd_create_reg(R1),
+                 OPND_CREATE_INT8(access_size - 1)));
     }
+    APPEND(cmp(drcontext, opnd_create_reg(R1_8), opnd_create_reg(R2_8)));
+    APPEND(jcc(drcontext, OP_jl_short, opnd_create_instr(OK_label)));
   }
-  if (!address_in_R1) {
-    // Otherwise, we need to compute the addr into R1.
-    // TODO: reuse some spare register? e.g. r15 on x64
-    // TODO: might be used as a non-mem-ref register?
-    R1 = DR_REG_XAX;
+  APPEND(jmp(drcontext, opnd_create_pc(report_stub)));
+  APPENDF(OK_label);
+  APPEND(ret(drcontext));
+}
+
+// One per (is_write, access size): the slow path shared by the checks.
+void AppendSharedReportStub(void *drcontext, instrlist_t *ilist,
+                            int is_write, int sz_idx) {
+  dr_restore_reg(drcontext, ilist, NULL, DR_REG_XAX, SPILL_SLOT_4);
+  APPEND(mov_ld(drcontext, opnd_create_reg(DR_REG_XDX),
+                OPND_CREATE_MEMPTR(DR_REG_XSP, 0)));
+  dr_insert_clean_call(drcontext, ilist, NULL, (void *)ReportFromSharedCheck,
+                       false, 4, opnd_create_reg(DR_REG_XAX),
+                       opnd_create_reg(DR_REG_XDX), OPND_CREATE_INT32(is_write),
+                       OPND_CREATE_INT32(sz_idx));
+}
+
+#undef APPEND
+#undef APPENDF
+
+byte *EncodeShared(void *drcontext, instrlist_t *ilist, byte *pc, byte *end) {
+  byte *next = instrlist_encode(drcontext, ilist, pc, true);
+  CHECK(next != NULL && next <= end);
+  instrlist_clear_and_destroy(drcontext, ilist);
+  return next;
+}
+
+// Generates the routines of -shared_checks once, at init. A check site then
+// only needs to call one of them with the address in R1:
+//   lea  -128(%rsp), %rsp   # keep the return address off the red zone
+//   mov  $routine, R2
+//   call *R2
+//   lea  128(%rsp), %rsp
+// That is about a third of an inline check, which matters for big modules
+// that would otherwise thrash DR's code cache.
+void BuildSharedChecks() {
+  void *drcontext = dr_get_current_drcontext();
+  const size_t kSize = 64 << 10;
+  byte *start = (byte *)dr_nonheap_alloc(kSize, DR_MEMPROT_READ |
+                                         DR_MEMPROT_WRITE | DR_MEMPROT_EXEC);
+  byte *end = start + kSize, *pc = start;
+
+  app_pc report_stubs[2][4];
+  for (int is_write = 0; is_write < 2; is_write++) {
+    for (int sz_idx = 0; sz_idx < 4; sz_idx++) {
+      instrlist_t *ilist = instrlist_create(drcontext);
+      AppendSharedReportStub(drcontext, ilist, is_write, sz_idx);
+      report_stubs[is_write][sz_idx] = pc;
+      pc = EncodeShared(drcontext, ilist, pc, end);
+    }
   }
-  CHECK(reg_is_pointer_sized(R1));  // otherwise R1_8 and R2 may be wrong.
-  reg_id_t R1_8 = reg_32_to_opsz(IF_X64_ELSE(reg_64_to_32(R1), R1), OPSZ_1);
 
-  // Pick R2 that's not R1 or used by the operand.  It's OK if the instr uses
-  // R2 elsewhere, since we'll restore it before instr.
-  reg_id_t GPR_TO_USE_FOR_R2[] = {
-    DR_REG_XAX, DR_REG_XBX, DR_REG_XCX, DR_REG_XDX
-    // Don't forget to update the +4 below if you add anything else!
-  };
-  std::set<reg_id_t> unused_registers(GPR_TO_USE_FOR_R2, GPR_TO_USE_FOR_R2+4);
-  unused_registers.erase(R1);
-  for (int j = 0; j < opnd_num_regs_used(op); j++) {
-    unused_registers.erase(opnd_get_reg_used(op, j));
+  AccessType types[] = { WRITE, READ, ROUGH_READ };
+  for (int t = 0; t < 3; t++) {
+    for (int sz_idx = 0; sz_idx < 4; sz_idx++) {
+      for (int r1 = 0; r1 < kNumSharedCheckRegs; r1++) {
+        for (int r2 = 0; r2 < 4; r2++) {
+          if (r1 == r2)
+            continue;
+          instrlist_t *ilist = instrlist_create(drcontext);
+          AppendSharedCheck(drcontext, ilist, types[t], sz_idx,
+                            kSharedCheckRegs[r1], kSharedCheckRegs[r2],
+                            report_stubs[types[t] == WRITE][sz_idx]);
+          g_shared_checks[types[t]][sz_idx][r1][r2] = pc;
+          pc = EncodeShared(drcontext, ilist, pc, end);
+        }
+      }
+    }
   }
+  dr_memory_protect(start, kSize, DR_MEMPROT_READ | DR_MEMPROT_EXEC);
+#if defined(VERBOSE)
+  dr_printf("==DRASAN== Shared checks: %d bytes at %p\n", pc - start, start);
+#endif
+}
 
-  CHECK(unused_registers.size() > 0);
-  reg_id_t R2 = *unused_registers.begin(),
-           R2_8 = reg_resize_to_opsz(R2, OPSZ_1);
-  CHECK(R1 != R2);
+// The call site of a shared check, R1 holding the address of |op|.
+void InsertSharedCheckCall(void *drcontext, instrlist_t *bb, instr_t *i,
+                           opnd_t op, AccessType access_type,
+                           reg_id_t R1, reg_id_t R2) {
+  int r1 = SharedCheckRegIndex(R1), r2 = SharedCheckRegIndex(R2);
+  CHECK(r1 >= 0 && r2 >= 0 && r2 < 4);
+  app_pc routine = g_shared_checks[access_type][AccessSizeIndex(op)][r1][r2];
+  CHECK(routine != NULL);
+  g_shared_check_sites++;
+
+  const int kRedZoneSize = IF_X64_ELSE(128, 0);
+  if (kRedZoneSize) {
+    PRE(i, lea(drcontext, opnd_create_reg(DR_REG_XSP),
+               OPND_CREATE_MEM_lea(DR_REG_XSP, DR_REG_NULL, 0,
+                                   -kRedZoneSize)));
+  }
+  PRE(i, mov_imm(drcontext, opnd_create_reg(R2), OPND_CREATE_INTPTR(routine)));
+  // ReportFromSharedCheck translates the call back to the access.
+  instr_t *call = INSTR_CREATE_call_ind(drcontext, opnd_create_reg(R2));
+  instr_set_translation(call, instr_get_app_pc(i));
+  PREF(i, call);
+  if (kRedZoneSize) {
+    PRE(i, lea(drcontext, opnd_create_reg(DR_REG_XSP),
+               OPND_CREATE_MEM_lea(DR_REG_XSP, DR_REG_NULL, 0,
+                                   kRedZoneSize)));
+  }
+}
 
-  // Save the current values of R1 and R2.
-  dr_save_reg(drcontext, bb, i, R1, SPILL_SLOT_1);
-  // TODO: Something smarter than spilling a "fixed" register R2?
-  dr_save_reg(drcontext, bb, i, R2, SPILL_SLOT_2);
+opnd_t LoopTlsOperand(LoopTlsSlot slot) {
+  return opnd_create_far_base_disp(g_loop_tls_segment, DR_REG_NULL,
+                                   DR_REG_NULL, 0,
+                                   g_loop_tls_offset + slot * sizeof(void *),
+                                   OPSZ_PTR);
+}
 
-  if (!address_in_R1)
-    CHECK(drutil_insert_get_mem_addr(drcontext, bb, i, op, R1, R2));
+// The -recover trap code, with the bad address in R1. Nothing is allocated
+// at instrumentation time: a PC that owns its slot, having reported already,
+// only bumps the slot's counter, any other goes to ReportRecoverable:
+//   mov  R1, SPILL_SLOT_4
+//   mov  $GetReportSlot(pc), R2
+//   mov  $pc, R1
+//   cmp  R1, ReportSlot::pc(R2)
+//   jne  report
+//   lock incl ReportSlot::repeats(R2)
+//   jmp  OK_label
+// report:
+//   <clean call ReportRecoverable>
+//   jmp  OK_label
+void InsertRecoverableReport(void *drcontext, instrlist_t *bb, instr_t *i,
+                             bool is_write, uint access_size,
+                             reg_id_t R1, reg_id_t R2, instr_t *OK_label) {
+  app_pc pc = instr_get_app_pc(i);
+  instr_t *report_label = INSTR_CREATE_label(drcontext);
+  dr_save_reg(drcontext, bb, i, R1, SPILL_SLOT_4);
+  PRE(i, mov_imm(drcontext, opnd_create_reg(R2),
+                 OPND_CREATE_INTPTR(GetReportSlot(pc))));
+  PRE(i, mov_imm(drcontext, opnd_create_reg(R1), OPND_CREATE_INTPTR(pc)));
+  PRE(i, cmp(drcontext,
+             OPND_CREATE_MEMPTR(R2, offsetof(ReportSlot, pc)),
+             opnd_create_reg(R1)));
+  PRE(i, jcc(drcontext, OP_jne, opnd_create_instr(report_label)));
+  PREF(i, LOCK(INSTR_CREATE_inc(drcontext,
+                                OPND_CREATE_MEM32(R2, offsetof(ReportSlot,
+                                                               repeats)))));
+  PRE(i, jmp(drcontext, opnd_create_instr(OK_label)));
+  PREF(i, report_label);
+  dr_insert_clean_call(drcontext, bb, i, (void *)ReportRecoverable, false, 4,
+                       dr_reg_spill_slot_opnd(drcontext, SPILL_SLOT_4),
+                       OPND_CREATE_INTPTR(pc), OPND_CREATE_INT32(is_write),
+                       OPND_CREATE_INT32(access_size));
+  PRE(i, jmp(drcontext, opnd_create_instr(OK_label)));
+}
+
+// The check itself, with the address of |op| in R1: falls through to the
+// trap code if the access is bad and jumps to |OK_label| otherwise.
+void InsertInlineCheck(void *drcontext, instrlist_t *bb, instr_t *i,
+                       opnd_t op, AccessType access_type,
+                       reg_id_t R1, reg_id_t R2, bool address_in_R1,
+                       bool has_segment, instr_t *OK_label) {
+  reg_id_t R1_8 = reg_32_to_opsz(IF_X64_ELSE(reg_64_to_32(R1), R1), OPSZ_1),
+           R2_8 = reg_resize_to_opsz(R2, OPSZ_1);
   PRE(i, shr(drcontext, opnd_create_reg(R1), OPND_CREATE_INT8(3)));
   PRE(i, mov_imm(drcontext, opnd_create_reg(R2),
                  OPND_CREATE_INTPTR(kShadowOffset)));
   PRE(i, add(drcontext, opnd_create_reg(R2), opnd_create_reg(R1)));
 
-  instr_t *OK_label = INSTR_CREATE_label(drcontext);
   if (access_type == ROUGH_READ) {
     PRE(i, cmp(drcontext, OPND_CREATE_MEM8(R2,0), OPND_CREATE_INT8(8)));
     PRE(i, jcc(drcontext, OP_jb_short, opnd_create_instr(OK_label)));
@@ -367,12 +901,14 @@ void InstrumentMops(void *drcontext, instrlist_t *bb,
     PRE(i, mov_ld(drcontext, opnd_create_reg(R2_8), opnd_create_reg(R1_8)));
     // Slowpath to support accesses smaller than pointer-sized.
     // TODO: do we need to restore R1 if address_in_R1 == false?
-    dr_restore_reg(drcontext, bb, i, R1, SPILL_SLOT_1);
-    if (!address_in_R1) {
-      // Assuming R2 is not clobbered here, which is true unless op has a
-      // segment.
-      CHECK(opnd_get_segment(op) == DR_REG_NULL);
-      CHECK(drutil_insert_get_mem_addr(drcontext, bb, i, op, R1, R2));
+    if (has_segment) {
+      dr_restore_reg(drcontext, bb, i, R1, SPILL_SLOT_4);
+    } else {
+      dr_restore_reg(drcontext, bb, i, R1, SPILL_SLOT_1);
+      if (!address_in_R1) {
+        // R2 is not clobbered here, as op has no segment.
+        CHECK(drutil_insert_get_mem_addr(drcontext, bb, i, op, R1, R2));
+      }
     }
     PRE(i, and(drcontext, opnd_create_reg(R1), OPND_CREATE_INT8(7)));
     if (access_size > 1) {
@@ -388,10 +924,19 @@ void InstrumentMops(void *drcontext, instrlist_t *bb,
   // Restore both R1 and R2 as the original address may depend on either of
   // them. Probably it's not necessary to always restore both, but this is
   // only executed once in a app lifetime, so don't bother much yet.
-  dr_restore_reg(drcontext, bb, i, R1, SPILL_SLOT_1);
-  if (!address_in_R1) {
-    dr_restore_reg(drcontext, bb, i, R2, SPILL_SLOT_2);
-    CHECK(drutil_insert_get_mem_addr(drcontext, bb, i, op, R1, R2));
+  if (has_segment) {
+    dr_restore_reg(drcontext, bb, i, R1, SPILL_SLOT_4);
+  } else {
+    dr_restore_reg(drcontext, bb, i, R1, SPILL_SLOT_1);
+    if (!address_in_R1) {
+      dr_restore_reg(drcontext, bb, i, R2, SPILL_SLOT_2);
+      CHECK(drutil_insert_get_mem_addr(drcontext, bb, i, op, R1, R2));
+    }
+  }
+  if (g_recover) {
+    InsertRecoverableReport(drcontext, bb, i, access_type == WRITE,
+                            opnd_size_in_bytes(op_size), R1, R2, OK_label);
+    return;
   }
 
   // 2) Align the stack by 16 bytes before making a call.
@@ -450,6 +995,133 @@ void InstrumentMops(void *drcontext, instrlist_t *bb,
   // We may want to get back to ud2a handling in the RTL as we did before as we
   // can set translation field to the original instruction in DR and make stacks
   // look very sane.
+}
+
+// A hoisted operand is only checked if the loop entry check couldn't vouch
+// for it (LOOP_TLS_CHECKED is zero). That is tested first, with jecxz, so
+// that the iterations of a vouched-for loop skip the spills and the flags:
+//   mov   %xcx, SPILL_SLOT_2
+//   mov   LOOP_TLS_CHECKED, %xcx
+//   jecxz check
+//   mov   SPILL_SLOT_2, %xcx
+//   jmp   hoisted_label
+// check:
+//   mov   SPILL_SLOT_2, %xcx
+//   <spills, the check, restores>
+// hoisted_label:
+// A shared check calls one of the routines of BuildSharedChecks instead of
+// inlining it.
+void InstrumentMops(void *drcontext, instrlist_t *bb,
+                    instr_t *i, opnd_t op, AccessType access_type,
+                    bool hoisted, bool shared)
+{
+  instr_t *hoisted_label = NULL;
+  if (hoisted) {
+    hoisted_label = INSTR_CREATE_label(drcontext);
+    instr_t *check_label = INSTR_CREATE_label(drcontext);
+    dr_save_reg(drcontext, bb, i, DR_REG_XCX, SPILL_SLOT_2);
+    PRE(i, mov_ld(drcontext, opnd_create_reg(DR_REG_XCX),
+                  LoopTlsOperand(LOOP_TLS_CHECKED)));
+    PRE(i, jecxz(drcontext, opnd_create_instr(check_label)));
+    dr_restore_reg(drcontext, bb, i, DR_REG_XCX, SPILL_SLOT_2);
+    PRE(i, jmp(drcontext, opnd_create_instr(hoisted_label)));
+    PREF(i, check_label);
+    dr_restore_reg(drcontext, bb, i, DR_REG_XCX, SPILL_SLOT_2);
+  }
+
+  bool need_to_restore_eflags = false;
+  uint flags = instr_get_arith_flags(i);
+  // TODO: do something smarter with flags and spills in general?
+  // For example, spill them only once for a sequence of instrumented
+  // instructions that don't change/read flags.
+
+  if (!TESTALL(EFLAGS_WRITE_6, flags) || TESTANY(EFLAGS_READ_6, flags)) {
+#if defined(VERBOSE_VERBOSE)
+    dr_printf("Spilling eflags...\n");
+#endif
+    need_to_restore_eflags = true;
+    // TODO: Maybe sometimes don't need to 'seto'.
+    // TODO: Maybe sometimes don't want to spill XAX here?
+    // TODO: No need to spill XAX here if XAX is not used in the BB.
+    dr_save_reg(drcontext, bb, i, DR_REG_XAX, SPILL_SLOT_1);
+    dr_save_arith_flags_to_xax(drcontext, bb, i);
+    dr_save_reg(drcontext, bb, i, DR_REG_XAX, SPILL_SLOT_3);
+    dr_restore_reg(drcontext, bb, i, DR_REG_XAX, SPILL_SLOT_1);
+  }
+
+#if 0
+  dr_printf("==DRASAN== DEBUG: %d %d %d %d %d %d\n",
+            opnd_is_memory_reference(op),
+            opnd_is_base_disp(op),
+            opnd_get_index(op),
+            opnd_is_far_memory_reference(op),
+            opnd_is_reg_pointer_sized(op),
+            opnd_is_base_disp(op) ? opnd_get_disp(op) : -1
+            );
+#endif
+
+  reg_id_t R1;
+  bool address_in_R1 = false;
+  if (opnd_is_base_disp(op) && opnd_get_index(op) == DR_REG_NULL &&
+      opnd_get_disp(op) == 0 && opnd_get_segment(op) == DR_REG_NULL) {
+    // If this is a simple access with no offset or index,
+    // we can try to just use the base for R1.
+    R1 = opnd_get_base(op);
+
+    // Can only use R1 if it's down-size'able to 8 bytes.
+    // TODO(timurrrr): is there a handy helper function around?
+    switch (R1) {
+    case DR_REG_XAX: case DR_REG_XBX: case DR_REG_XCX: case DR_REG_XDX:
+#if __WORDSIZE == 64
+    case DR_REG_R8: case DR_REG_R9: case DR_REG_R10: case DR_REG_R11:
+    case DR_REG_R12: case DR_REG_R13: case DR_REG_R14: case DR_REG_R15:
+#endif
+      address_in_R1 = true;
+    }
+  }
+  if (!address_in_R1) {
+    // Otherwise, we need to compute the addr into R1.
+    // TODO: reuse some spare register? e.g. r15 on x64
+    // TODO: might be used as a non-mem-ref register?
+    R1 = DR_REG_XAX;
+  }
+  CHECK(reg_is_pointer_sized(R1));  // otherwise R1_8 and R2 may be wrong.
+
+  // Pick R2 that's not R1 or used by the operand.  It's OK if the instr uses
+  // R2 elsewhere, since we'll restore it before instr.
+  reg_id_t GPR_TO_USE_FOR_R2[] = {
+    DR_REG_XAX, DR_REG_XBX, DR_REG_XCX, DR_REG_XDX
+    // Don't forget to update the +4 below if you add anything else!
+  };
+  std::set<reg_id_t> unused_registers(GPR_TO_USE_FOR_R2, GPR_TO_USE_FOR_R2+4);
+  unused_registers.erase(R1);
+  for (int j = 0; j < opnd_num_regs_used(op); j++) {
+    unused_registers.erase(opnd_get_reg_used(op, j));
+  }
+
+  CHECK(unused_registers.size() > 0);
+  reg_id_t R2 = *unused_registers.begin();
+  CHECK(R1 != R2);
+
+  // Save the current values of R1 and R2.
+  dr_save_reg(drcontext, bb, i, R1, SPILL_SLOT_1);
+  // TODO: Something smarter than spilling a "fixed" register R2?
+  dr_save_reg(drcontext, bb, i, R2, SPILL_SLOT_2);
+
+  // Getting the segment base clobbers R2, which holds the shadow value when
+  // we need the address again, so keep the address of TLS accesses around.
+  bool has_segment = opnd_get_segment(op) != DR_REG_NULL;
+  if (!address_in_R1)
+    CHECK(drutil_insert_get_mem_addr(drcontext, bb, i, op, R1, R2));
+  if (has_segment && !shared)
+    dr_save_reg(drcontext, bb, i, R1, SPILL_SLOT_4);
+  instr_t *OK_label = INSTR_CREATE_label(drcontext);
+  if (shared) {
+    InsertSharedCheckCall(drcontext, bb, i, op, access_type, R1, R2);
+  } else {
+    InsertInlineCheck(drcontext, bb, i, op, access_type, R1, R2,
+                      address_in_R1, has_segment, OK_label);
+  }
 
   PREF(i, OK_label);
   // Restore the registers and flags.
@@ -466,6 +1138,8 @@ void InstrumentMops(void *drcontext, instrlist_t *bb,
     dr_restore_arith_flags_from_xax(drcontext, bb, i);
     dr_restore_reg(drcontext, bb, i, DR_REG_XAX, SPILL_SLOT_1);
   }
+  if (hoisted)
+    PREF(i, hoisted_label);
 
   // The original instruction is left untouched. The above instrumentation is just
   // a prefix.
@@ -529,6 +1203,15 @@ bool ShouldUseRoughReadChecks(ModuleData *mod_data) {
   return false;
 }
 
+CheckMode GetModuleCheckMode(ModuleData *mod_data) {
+  for (size_t i = 0; i < g_module_check_modes.size(); i++) {
+    if (mod_data->path_.find(g_module_check_modes[i].substring) !=
+        string::npos)
+      return g_module_check_modes[i].mode;
+  }
+  return g_check_mode;
+}
+
 bool ShouldInstrumentModule(ModuleData *mod_data) {
   // TODO(rnk): Flags for blacklist would get wired in here.
   const string &path = mod_data->path_;
@@ -549,18 +1232,361 @@ bool ShouldInstrumentModule(ModuleData *mod_data) {
   // TODO: We don't want to instrument modules which were already instrumented
   // by the compiler ASan. We can check if the module imports __asan_init, but
   // we'll need DR support or a bunch of ELF parsing routines in dr_asan.
-  // For the time being, only instrument /lib and /usr/lib.
+  // For the time being, only instrument /lib and /usr/lib, and whatever
+  // -instrument_module asks for.
   // See http://code.google.com/p/address-sanitizer/issues/detail?id=80
   // We may also consider adding a new flag to ASAN_OPTIONS to disable instrumentation
   // of the listed modules.
+  for (size_t i = 0; i < g_instrument_modules.size(); i++) {
+    if (path.find(g_instrument_modules[i]) != string::npos)
+      return true;
+  }
   if (path.substr(0, 4) != "/lib" && path.substr(0, 8) != "/usr/lib")
     return false;
 
   return true;
 }
 
+// A memory operand that a loop trace with induction register |base| checks
+// at entry rather than on every iteration.
+bool OperandIsHoistable(opnd_t op, reg_id_t base) {
+  return OperandIsInteresting(op) && opnd_get_base(op) == base &&
+         opnd_get_index(op) == DR_REG_NULL &&
+         opnd_get_segment(op) == DR_REG_NULL;
+}
+
+// Checks the memory operands of |i| that |mod_data| asks for. Operands based
+// on |hoisted_base| (DR_REG_NULL outside loop traces) are hoisted.
+void InstrumentInstr(void *drcontext, instrlist_t *bb, instr_t *i,
+                     ModuleData *mod_data, reg_id_t hoisted_base) {
+  // TODO: drutil_expand_rep_string/_ex, otherwise we're only checking
+  // the first mop. However, we probably only want the first and the last one?
+
+  // TODO: Some instructions (e.g. lock xadd) may read & write the same memory
+  // location. Optimize the instrumentation to only check the write.
+
+  if (instr_reads_memory(i) && mod_data->check_reads_) {
+    // Instrument memory reads
+    bool instrumented_anything = false;
+    for (int s = 0; s < instr_num_srcs(i); s++) {
+      opnd_t op = instr_get_src(i, s);
+      if (!OperandIsInteresting(op))
+        continue;
+
+      // TODO: CMPS may not pass this check.
+      // Probably, should use drutil_expand_rep_string
+      CHECK(!instrumented_anything);
+      instrumented_anything = true;
+      InstrumentMops(drcontext, bb, i, op,
+                     mod_data->should_use_rough_reads_ ? ROUGH_READ : READ,
+                     OperandIsHoistable(op, hoisted_base),
+                     mod_data->use_shared_checks_);
+
+    }
+  }
+
+  if (instr_writes_memory(i) && mod_data->check_writes_) {
+    // Instrument memory writes
+    bool instrumented_anything = false;
+    for (int d = 0; d < instr_num_dsts(i); d++) {
+      opnd_t op = instr_get_dst(i, d);
+      if (!OperandIsInteresting(op))
+        continue;
+
+      CHECK(!instrumented_anything);
+      instrumented_anything = true;
+      InstrumentMops(drcontext, bb, i, op, WRITE,
+                     OperandIsHoistable(op, hoisted_base),
+                     mod_data->use_shared_checks_);
+    }
+  }
+}
+
+// Returns true if |reg| is written by exactly one instruction before |end|,
+// which adds a non-zero constant to it.
+bool RegHasConstantStride(instrlist_t *trace, instr_t *end, reg_id_t reg,
+                          instr_t **update, ptr_int_t *stride) {
+  *update = NULL;
+  for (instr_t *i = instrlist_first(trace); i != end; i = instr_get_next(i)) {
+    if (!instr_ok_to_mangle(i) || !instr_writes_to_reg(i, reg))
+      continue;
+    if (*update != NULL || instr_num_dsts(i) == 0 ||
+        !opnd_is_reg(instr_get_dst(i, 0)) ||
+        opnd_get_reg(instr_get_dst(i, 0)) != reg)
+      return false;
+    *update = i;
+    opnd_t src = instr_get_src(i, 0);
+    switch (instr_get_opcode(i)) {
+    case OP_add:
+    case OP_sub:
+      if (!opnd_is_immed_int(src))
+        return false;
+      *stride = opnd_get_immed_int(src);
+      if (instr_get_opcode(i) == OP_sub)
+        *stride = -*stride;
+      break;
+    case OP_inc:
+      *stride = 1;
+      break;
+    case OP_dec:
+      *stride = -1;
+      break;
+    case OP_lea:
+      if (opnd_get_base(src) != reg || opnd_get_index(src) != DR_REG_NULL ||
+          opnd_get_segment(src) != DR_REG_NULL)
+        return false;
+      *stride = opnd_get_disp(src);
+      break;
+    default:
+      return false;
+    }
+  }
+  return *update != NULL && *stride != 0;
+}
+
+bool RegIsWritten(instrlist_t *trace, instr_t *end, reg_id_t reg) {
+  for (instr_t *i = instrlist_first(trace); i != end; i = instr_get_next(i)) {
+    if (instr_ok_to_mangle(i) && instr_writes_to_reg(i, reg))
+      return true;
+  }
+  return false;
+}
+
+// Recognizes the loop traces described at LoopInfo. On success fills in
+// |loop| and the induction (|base|) and bound (|bound|) registers.
+bool AnalyzeLoopTrace(void *tag, instrlist_t *trace, ModuleData *mod_data,
+                      LoopInfo *loop, reg_id_t *base, reg_id_t *bound) {
+  app_pc head = dr_fragment_app_pc(tag);
+  instr_t *back_edge = NULL, *compare = NULL;
+  for (instr_t *i = instrlist_first(trace); i != NULL; i = instr_get_next(i)) {
+    if (!instr_ok_to_mangle(i))
+      continue;
+    if (back_edge != NULL) {
+      // Only the exit to the loop's fall-through may follow the back edge.
+      if (!instr_is_ubr(i))
+        return false;
+      continue;
+    }
+    if (instr_is_cbr(i)) {
+      opnd_t target = instr_get_target(i);
+      if (!opnd_is_pc(target) || opnd_get_pc(target) != head ||
+          (instr_get_opcode(i) != OP_jne &&
+           instr_get_opcode(i) != OP_jne_short))
+        return false;
+      back_edge = i;
+      continue;
+    }
+    // Any other exit would end the loop early, with less memory touched than
+    // checked at entry.
+    if (instr_is_cti(i) || instr_is_syscall(i))
+      return false;
+    // The range is collected with the check mode of the head's module.
+    if (instr_get_app_pc(i) < mod_data->start_ ||
+        instr_get_app_pc(i) >= mod_data->end_)
+      return false;
+    compare = i;
+  }
+  if (back_edge == NULL || compare == NULL ||
+      instr_get_opcode(compare) != OP_cmp)
+    return false;
+
+  opnd_t left = instr_get_src(compare, 0), right = instr_get_src(compare, 1);
+  if (!opnd_is_reg(left) || !opnd_is_reg(right) ||
+      !reg_is_pointer_sized(opnd_get_reg(left)) ||
+      !reg_is_pointer_sized(opnd_get_reg(right)))
+    return false;
+  instr_t *update;
+  if (RegHasConstantStride(trace, back_edge, opnd_get_reg(left), &update,
+                           &loop->stride) &&
+      !RegIsWritten(trace, back_edge, opnd_get_reg(right))) {
+    *base = opnd_get_reg(left);
+    *bound = opnd_get_reg(right);
+  } else if (RegHasConstantStride(trace, back_edge, opnd_get_reg(right),
+                                  &update, &loop->stride) &&
+             !RegIsWritten(trace, back_edge, opnd_get_reg(left))) {
+    *base = opnd_get_reg(right);
+    *bound = opnd_get_reg(left);
+  } else {
+    return false;
+  }
+  if (*base == DR_REG_XSP)
+    return false;
+
+  // Collect the extent of the operands that InstrumentInstr will hoist.
+  bool after_update = false, found = false;
+  for (instr_t *i = instrlist_first(trace); i != back_edge;
+       i = instr_get_next(i)) {
+    if (i == update)
+      after_update = true;
+    if (!instr_ok_to_mangle(i) || !WantToInstrument(i))
+      continue;
+    for (int n = 0; n < instr_num_srcs(i) + instr_num_dsts(i); n++) {
+      bool is_src = n < instr_num_srcs(i);
+      opnd_t op = is_src ? instr_get_src(i, n)
+                         : instr_get_dst(i, n - instr_num_srcs(i));
+      if ((is_src ? !instr_reads_memory(i) || !mod_data->check_reads_
+                  : !instr_writes_memory(i) || !mod_data->check_writes_) ||
+          !OperandIsHoistable(op, *base))
+        continue;
+      ptr_int_t disp = opnd_get_disp(op) + (after_update ? loop->stride : 0);
+      ptr_int_t end = disp + opnd_size_in_bytes(opnd_get_size(op));
+      if (!found || disp < loop->min_disp)
+        loop->min_disp = disp;
+      if (!found || end > loop->max_end)
+        loop->max_end = end;
+      found = true;
+    }
+  }
+  return found;
+}
+
+ptr_int_t *LoopTlsSlots() {
+  return (ptr_int_t *)((byte *)dr_get_dr_segment_base(g_loop_tls_segment) +
+                       g_loop_tls_offset);
+}
+
+// Returns true if every byte of [beg, end) is addressable according to the
+// shadow memory.
+bool RegionIsAddressable(ptr_uint_t beg, ptr_uint_t end) {
+  // Don't spend too long at one loop entry, and keep garbage bounds away
+  // from the unmapped parts of the shadow.
+  const ptr_uint_t kMaxRegionSize = 64 << 20;
+  const ptr_uint_t kMaxAppAddress = IF_X64_ELSE(0x7fffffffffffULL, ~0UL);
+  if (end <= beg || end - beg > kMaxRegionSize || end > kMaxAppAddress)
+    return false;
+  for (ptr_uint_t a = beg & ~(ptr_uint_t)7; a < end; a += 8) {
+    signed char *shadow = (signed char *)((a >> 3) + kShadowOffset);
+    // Eight whole granules at a time while aligned.
+    if ((a & 63) == 0 && end - a >= 64 && *(uint64 *)shadow == 0) {
+      a += 56;
+      continue;
+    }
+    // A granule with shadow k > 0 has its first k bytes addressable.
+    if (*shadow != 0 &&
+        (*shadow < 0 || std::min(a + 8, end) - a > (ptr_uint_t)*shadow))
+      return false;
+  }
+  return true;
+}
+
+// Clean call at the head of a loop trace, on entry to the loop: checks all
+// the memory the hoisted operands of this execution of the loop will touch.
+void ValidateLoop(LoopInfo *loop, ptr_int_t base, ptr_int_t bound) {
+  ptr_int_t distance = bound - base;
+  ptr_int_t iterations = 0;
+  if (distance != 0 && (distance > 0) == (loop->stride > 0) &&
+      distance % loop->stride == 0)
+    iterations = distance / loop->stride;
+  bool checked = false;
+  if (iterations > 0) {
+    // The first and the last value of base at the trace head.
+    ptr_int_t last = bound - loop->stride;
+    ptr_int_t low = std::min(base, last), high = std::max(base, last);
+    checked = RegionIsAddressable(low + loop->min_disp, high + loop->max_end);
+  }
+  ptr_int_t *slots = LoopTlsSlots();
+  slots[LOOP_TLS_OWNER] = loop->id;
+  // With no sane trip count, the loop will not terminate by its own
+  // condition. Keep checking every iteration rather than validate again.
+  slots[LOOP_TLS_BUDGET] =
+      iterations > 0 ? iterations - 1 : (ptr_int_t)(~(ptr_uint_t)0 >> 1);
+  slots[LOOP_TLS_CHECKED] = checked;
+}
+
+// The LoopInfo for |loop| at the trace head |pc|. Loops are only compared by
+// value: with thread-private caches, traces of different threads may start
+// at the same PC and still be different loops.
+LoopInfo *GetLoopInfo(app_pc pc, const LoopInfo &loop) {
+  dr_mutex_lock(g_loop_infos_lock);
+  LoopInfo *info = NULL;
+  std::pair<LoopInfoMap::iterator, LoopInfoMap::iterator> range =
+      g_loop_infos->equal_range(pc);
+  for (LoopInfoMap::iterator it = range.first; it != range.second; ++it) {
+    LoopInfo *other = it->second;
+    if (other->stride == loop.stride && other->min_disp == loop.min_disp &&
+        other->max_end == loop.max_end) {
+      info = other;
+      break;
+    }
+  }
+  if (info == NULL) {
+    static int next_id = 1;  // 0 is what a new thread's slot holds.
+    info = (LoopInfo *)dr_global_alloc(sizeof(*info));
+    *info = loop;
+    info->id = next_id++;
+    g_loop_infos->insert(std::make_pair(pc, info));
+  }
+  dr_mutex_unlock(g_loop_infos_lock);
+  return info;
+}
+
+// Frees the LoopInfos of the traces with a head in [start, end). Their
+// traces must be gone.
+void FreeLoopInfos(app_pc start, app_pc end) {
+  dr_mutex_lock(g_loop_infos_lock);
+  LoopInfoMap::iterator it = g_loop_infos->lower_bound(start);
+  while (it != g_loop_infos->end() && it->first < end) {
+    dr_global_free(it->second, sizeof(LoopInfo));
+    g_loop_infos->erase(it++);
+  }
+  dr_mutex_unlock(g_loop_infos_lock);
+}
+
+// Inserts the loop entry check at |i|, the head of a loop trace. The first
+// iteration of every execution of the loop runs ValidateLoop, the following
+// ones only count down its budget. Tying the result to one execution keeps
+// the loop from relying on a stale check, e.g. after the memory it walks got
+// freed. The countdown runs every iteration, so it tests with jecxz and
+// leaves the flags alone (the clean call saves them itself):
+//   mov   %xcx, SPILL_SLOT_2
+//   mov   LOOP_TLS_OWNER, %xcx
+//   lea   -id(%xcx), %xcx
+//   jecxz owner_ok
+//   jmp   validate
+// owner_ok:
+//   mov   LOOP_TLS_BUDGET, %xcx
+//   jecxz validate
+//   lea   -1(%xcx), %xcx
+//   mov   %xcx, LOOP_TLS_BUDGET
+//   jmp   done
+// validate:
+//   mov   SPILL_SLOT_2, %xcx
+//   <clean call ValidateLoop>
+// done:
+//   mov   SPILL_SLOT_2, %xcx
+void InsertLoopEntryCheck(void *drcontext, instrlist_t *bb, instr_t *i,
+                          LoopInfo *loop, reg_id_t base, reg_id_t bound) {
+  opnd_t xcx = opnd_create_reg(DR_REG_XCX);
+  instr_t *owner_ok_label = INSTR_CREATE_label(drcontext);
+  instr_t *validate_label = INSTR_CREATE_label(drcontext);
+  instr_t *done_label = INSTR_CREATE_label(drcontext);
+  dr_save_reg(drcontext, bb, i, DR_REG_XCX, SPILL_SLOT_2);
+  PRE(i, mov_ld(drcontext, xcx, LoopTlsOperand(LOOP_TLS_OWNER)));
+  PRE(i, lea(drcontext, xcx, OPND_CREATE_MEM_lea(DR_REG_XCX, DR_REG_NULL, 0,
+                                                 -loop->id)));
+  PRE(i, jecxz(drcontext, opnd_create_instr(owner_ok_label)));
+  PRE(i, jmp(drcontext, opnd_create_instr(validate_label)));
+  PREF(i, owner_ok_label);
+  PRE(i, mov_ld(drcontext, xcx, LoopTlsOperand(LOOP_TLS_BUDGET)));
+  PRE(i, jecxz(drcontext, opnd_create_instr(validate_label)));
+  PRE(i, lea(drcontext, xcx, OPND_CREATE_MEM_lea(DR_REG_XCX, DR_REG_NULL, 0,
+                                                 -1)));
+  PRE(i, mov_st(drcontext, LoopTlsOperand(LOOP_TLS_BUDGET), xcx));
+  PRE(i, jmp(drcontext, opnd_create_instr(done_label)));
+  PREF(i, validate_label);
+  dr_restore_reg(drcontext, bb, i, DR_REG_XCX, SPILL_SLOT_2);
+  dr_insert_clean_call(drcontext, bb, i, (void *)ValidateLoop, false, 3,
+                       OPND_CREATE_INTPTR(loop), opnd_create_reg(base),
+                       opnd_create_reg(bound));
+  PREF(i, done_label);
+  dr_restore_reg(drcontext, bb, i, DR_REG_XCX, SPILL_SLOT_2);
+}
+
 dr_emit_flags_t event_basic_block(void *drcontext, void *tag, instrlist_t *bb,
                                   bool for_trace, bool translating) {
+  // event_trace instruments the whole trace.
+  if (for_trace && g_use_traces)
+    return DR_EMIT_DEFAULT;
   app_pc pc = dr_fragment_app_pc(tag);
   // TODO(timurrrr): do we really need to run the slow LookupModuleByPC anymore?
   ModuleData *mod_data = LookupModuleByPC(pc);
@@ -595,6 +1621,8 @@ dr_emit_flags_t event_basic_block(void *drcontext, void *tag, instrlist_t *bb,
 #endif
 
   for (instr_t *i = instrlist_first(bb); i != NULL; i = instr_get_next(i)) {
+    if (g_print_stats)
+      CountOperands(i);
     if (!WantToInstrument(i))
       continue;
 
@@ -605,43 +1633,7 @@ dr_emit_flags_t event_basic_block(void *drcontext, void *tag, instrlist_t *bb,
               instr_get_app_pc(i) - orig_pc, instr_get_opcode(i), flags);
 #endif
 
-    // TODO: drutil_expand_rep_string/_ex, otherwise we're only checking
-    // the first mop. However, we probably only want the first and the last one?
-
-    // TODO: Some instructions (e.g. lock xadd) may read & write the same memory
-    // location. Optimize the instrumentation to only check the write.
-
-    if (instr_reads_memory(i)) {
-      // Instrument memory reads
-      bool instrumented_anything = false;
-      for (int s = 0; s < instr_num_srcs(i); s++) {
-        opnd_t op = instr_get_src(i, s);
-        if (!OperandIsInteresting(op))
-          continue;
-
-        // TODO: CMPS may not pass this check.
-        // Probably, should use drutil_expand_rep_string
-        CHECK(!instrumented_anything);
-        instrumented_anything = true;
-        InstrumentMops(drcontext, bb, i, op,
-                       mod_data->should_use_rough_reads_ ? ROUGH_READ : READ);
-
-      }
-    }
-
-    if (instr_writes_memory(i)) {
-      // Instrument memory writes
-      bool instrumented_anything = false;
-      for (int d = 0; d < instr_num_dsts(i); d++) {
-        opnd_t op = instr_get_dst(i, d);
-        if (!OperandIsInteresting(op))
-          continue;
-
-        CHECK(!instrumented_anything);
-        instrumented_anything = true;
-        InstrumentMops(drcontext, bb, i, op, WRITE);
-      }
-    }
+    InstrumentInstr(drcontext, bb, i, mod_data, DR_REG_NULL);
   }
 
   // TODO: optimize away redundant restore-spill pairs?
@@ -657,6 +1649,56 @@ dr_emit_flags_t event_basic_block(void *drcontext, void *tag, instrlist_t *bb,
   return DR_EMIT_PERSISTABLE;
 }
 
+// With -traces the blocks of a trace are left alone by event_basic_block and
+// the trace is instrumented here as a whole, so that the checks of loop
+// traces can be hoisted to the loop entry.
+dr_emit_flags_t event_trace(void *drcontext, void *tag, instrlist_t *trace,
+                            bool translating) {
+  // The head's module only decides about the loop analysis. event_basic_block
+  // left all the blocks of the trace unchecked, whatever the head is.
+  ModuleData *mod_data = LookupModuleByPC(dr_fragment_app_pc(tag));
+  LoopInfo loop;
+  reg_id_t base = DR_REG_NULL, bound = DR_REG_NULL;
+  if (mod_data != NULL && mod_data->should_instrument_ &&
+      AnalyzeLoopTrace(tag, trace, mod_data, &loop, &base, &bound)) {
+    LoopInfo *info = GetLoopInfo(dr_fragment_app_pc(tag), loop);
+    InsertLoopEntryCheck(drcontext, trace, instrlist_first(trace), info,
+                         base, bound);
+#if defined(VERBOSE)
+    dr_printf("Loop trace at %p: stride %d, range [%d, %d) around %d\n",
+              dr_fragment_app_pc(tag), (int)loop.stride, (int)loop.min_disp,
+              (int)loop.max_end, base);
+#endif
+  } else {
+    base = DR_REG_NULL;
+  }
+
+  // A trace may run through several modules, the blocks are instrumented
+  // according to their own. Those of modules we don't instrument are skipped,
+  // the trace may come back to an instrumented one after them.
+  for (instr_t *i = instrlist_first(trace); i != NULL; i = instr_get_next(i)) {
+    if (!instr_ok_to_mangle(i))
+      continue;
+    app_pc pc = instr_get_app_pc(i);
+    if (mod_data == NULL || pc < mod_data->start_ || pc >= mod_data->end_)
+      mod_data = LookupModuleByPC(pc);
+    if (mod_data == NULL || !mod_data->should_instrument_)
+      continue;
+    if (!WantToInstrument(i))
+      continue;
+    if (base != DR_REG_NULL && !translating) {
+      for (int n = 0; n < instr_num_srcs(i) + instr_num_dsts(i); n++) {
+        opnd_t op = n < instr_num_srcs(i) ?
+            instr_get_src(i, n) : instr_get_dst(i, n - instr_num_srcs(i));
+        if (OperandIsHoistable(op, base))
+          g_hoisted_operands++;
+      }
+    }
+    InstrumentInstr(drcontext, trace, i, mod_data, base);
+  }
+  return DR_EMIT_DEFAULT;
+}
+
 void event_module_load(void *drcontext, const module_data_t *info, bool loaded) {
   // Insert the module into the list while maintaining the ordering.
   ModuleData mod_data(info);
@@ -671,11 +1713,20 @@ void event_module_load(void *drcontext, const module_data_t *info, bool loaded)
   }
 
   it->should_use_rough_reads_ = ShouldUseRoughReadChecks(&*it);
+  CheckMode mode = GetModuleCheckMode(&*it);
+  it->check_reads_ = mode.reads;
+  it->check_writes_ = mode.writes;
+  it->use_shared_checks_ = g_shared_checks_mb >= 0 &&
+      (size_t)(it->end_ - it->start_) >= ((size_t)g_shared_checks_mb << 20);
 
 #if defined(VERBOSE)
-  dr_printf("==DRASAN== Loaded module: %s [%p...%p], instrumentation is %s\n",
+  dr_printf("==DRASAN== Loaded module: %s [%p...%p], instrumentation is %s"
+            " (reads %s, writes %s, %s checks)\n",
             info->full_path, info->start, info->end,
-            it->should_instrument_ ? "on" : "off");
+            it->should_instrument_ ? "on" : "off",
+            it->check_reads_ ? "on" : "off",
+            it->check_writes_ ? "on" : "off",
+            it->use_shared_checks_ ? "shared" : "inline");
 #endif
 }
 
@@ -696,9 +1747,53 @@ void event_module_unload(void *drcontext, const module_data_t *info) {
         it->end_ == mod_data.end_ &&
         it->path_ == mod_data.path_);
   g_module_list.erase(it);
+  // DR has flushed the module's code, traces included.
+  if (g_use_traces)
+    FreeLoopInfos(info->start, info->end);
 }
 
 void event_exit() {
+  if (g_print_stats) {
+    dr_fprintf(STDERR, "==DRASAN== Memory operands of the instrumented code:"
+               " %u checkable (%u plain, %u stack, %u TLS), %u in-frame"
+               " skipped, %u other skipped\n",
+               g_operand_stats[OPERAND_PLAIN] + g_operand_stats[OPERAND_STACK] +
+               g_operand_stats[OPERAND_TLS],
+               g_operand_stats[OPERAND_PLAIN], g_operand_stats[OPERAND_STACK],
+               g_operand_stats[OPERAND_TLS], g_operand_stats[OPERAND_FRAME],
+               g_operand_stats[OPERAND_SKIP]);
+    if (g_shared_checks_mb >= 0) {
+      dr_fprintf(STDERR, "==DRASAN== %u checks call shared routines\n",
+                 g_shared_check_sites);
+    }
+    if (g_use_traces) {
+      dr_fprintf(STDERR, "==DRASAN== %u operands of loop traces checked at"
+                 " loop entry\n", g_hoisted_operands);
+    }
+  }
+  if (g_recover) {
+    uint repeats = 0;
+    for (std::map<app_pc, uint>::iterator it = g_reported_pcs->begin();
+         it != g_reported_pcs->end(); ++it) {
+      ReportSlot *slot = GetReportSlot(it->first);
+      uint pc_repeats =
+          it->second + (slot->pc == it->first ? slot->repeats : 0);
+      repeats += pc_repeats;
+      if (pc_repeats > 0) {
+        dr_fprintf(STDERR, "==DRASAN== %p: %u more errors not reported\n",
+                   it->first, pc_repeats);
+      }
+    }
+    dr_fprintf(STDERR, "==DRASAN== %u places reported an error, %u repeated"
+               " errors not reported\n", (uint)g_reported_pcs->size(),
+               repeats);
+  }
+  if (g_use_traces) {
+    dr_raw_tls_cfree(g_loop_tls_offset, NUM_LOOP_TLS_SLOTS);
+    FreeLoopInfos(NULL, (app_pc)~(ptr_uint_t)0);
+    delete g_loop_infos;
+    dr_mutex_destroy(g_loop_infos_lock);
+  }
 #if defined(VERBOSE)
   dr_printf("==DRASAN== DONE\n");
 #endif
@@ -707,30 +1802,38 @@ void event_exit() {
 }  // namespace
 
 DR_EXPORT void dr_init(client_id_t id) {
+  ParseOptions(id);
   string app_name = dr_get_application_name();
-  // This blacklist will still run these apps through DR's code cache.  On the
-  // other hand, we are able to follow children of these apps.
-  // TODO(rnk): Once DR has detach, we could just detach here.  Alternatively,
-  // if DR had a fork or exec hook to let us decide there, that would be nice.
-  // TODO: make the blacklist cmd-adjustable.
-  if (app_name == "python" || app_name == "python2.7" ||
-      app_name == "ps" || app_name == "env" ||
-      app_name == "rm" || app_name == "sed" ||
-      app_name == "grep" || app_name == "basename" ||
-      app_name == "bash" || app_name == "sh" ||
-      app_name == "cat" || app_name == "touch" ||
-      app_name == "mkdir" || app_name == "cut" ||
-      app_name == "gawk" || app_name == "dbus-launch" ||
-      app_name == "mktemp" || app_name == "chmod" ||
-      app_name == "true" || app_name == "exit" ||
-      app_name == "yes" || app_name == "echo")
+  // Skipped apps still run through DR's code cache, uninstrumented, so that
+  // we follow their children.  DR can't detach on Linux, so the only way to
+  // run a process natively is to keep DR from injecting into it at exec:
+  // run.sh does that for DRASAN_NATIVE_APPS, see README.txt.
+  if (std::find(g_skip_apps.begin(), g_skip_apps.end(), app_name) !=
+      g_skip_apps.end())
     return;
 
   InitializeAsanCallbacks();
+  if (g_recover) {
+    // Global, not per thread: a PC reports once per process.
+    g_reported_pcs = new std::map<app_pc, uint>;
+    g_reported_pcs_lock = dr_mutex_create();
+    g_report_slots = (ReportSlot *)dr_global_alloc(kNumReportSlots *
+                                                   sizeof(ReportSlot));
+    memset(g_report_slots, 0, kNumReportSlots * sizeof(ReportSlot));
+  }
+  if (g_shared_checks_mb >= 0)
+    BuildSharedChecks();
 
   // Standard DR events.
   dr_register_exit_event(event_exit);
   dr_register_bb_event(event_basic_block);
+  if (g_use_traces) {
+    CHECK(dr_raw_tls_calloc(&g_loop_tls_segment, &g_loop_tls_offset,
+                            NUM_LOOP_TLS_SLOTS, 0));
+    g_loop_infos = new LoopInfoMap;
+    g_loop_infos_lock = dr_mutex_create();
+    dr_register_trace_event(event_trace);
+  }
   dr_register_module_load_event(event_module_load);
   dr_register_module_unload_event(event_module_unload);
 #if defined(VERBOSE)
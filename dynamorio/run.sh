@@ -1,4 +1,25 @@
 #!/bin/bash
 
 DIR=$(dirname $0)
-$DIR/bin64/drrun -disable_traces -c $DIR/libdr_asan.so $@
+# Client options, e.g. DRASAN_OPTIONS="-check writes -check_module all:/libfoo"
+# DR's traces are off unless the client instruments them (-traces).
+DR_OPTIONS=-disable_traces
+case " $DRASAN_OPTIONS " in
+  *" -traces "*) DR_OPTIONS= ;;
+esac
+
+# Children named in DRASAN_NATIVE_APPS run natively: DR doesn't inject into
+# them at exec, so they cost nothing, but their own children aren't followed
+# either. Keep it to tools that don't run other programs; the ones that do
+# are skipped by the client instead (-skip_app). The -norun configurations
+# live in a directory of our own rather than in ~/.dynamorio.
+DRASAN_NATIVE_APPS=${DRASAN_NATIVE_APPS-ps rm sed grep basename cat touch \
+mkdir cut gawk mktemp chmod true yes echo}
+if [ -n "$DRASAN_NATIVE_APPS" ]; then
+  export DYNAMORIO_CONFIGDIR=$(mktemp -d ${TMPDIR:-/tmp}/drasan-config.XXXXXX)
+  trap "rm -rf $DYNAMORIO_CONFIGDIR" EXIT
+  for app in $DRASAN_NATIVE_APPS; do
+    $DIR/bin64/drconfig -reg $app -norun || exit 1
+  done
+fi
+$DIR/bin64/drrun $DR_OPTIONS -c $DIR/libdr_asan.so $DRASAN_OPTIONS $@
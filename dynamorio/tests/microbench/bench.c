@@ -0,0 +1,76 @@
+// Driver of the DrASan micro-benchmarks, see README.txt.
+// Prints the cycles per instrumented access of every kernel:
+//   $ drasan_bench [-i ITERS] [-r REPS] [kernel-prefix...]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <x86intrin.h>
+
+#include "kernels.h"
+
+static int Selected(const char *name, int argc, char **argv) {
+  if (argc == 0)
+    return 1;
+  for (int i = 0; i < argc; i++) {
+    if (strncmp(name, argv[i], strlen(argv[i])) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  long iters = 1 << 20;
+  int reps = 5;
+  int opt;
+  while ((opt = getopt(argc, argv, "i:r:")) != -1) {
+    switch (opt) {
+    case 'i':
+      iters = atol(optarg);
+      break;
+    case 'r':
+      reps = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-i ITERS] [-r REPS] [kernel-prefix...]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (iters <= 0 || reps <= 0) {
+    fprintf(stderr, "ITERS and REPS must be positive\n");
+    return 1;
+  }
+
+  // Heap memory, so that the shadow says it is all addressable. The kernels
+  // use at most the first 2K.
+  char *buf;
+  if (posix_memalign((void **)&buf, 64, 4096) != 0)
+    return 1;
+  memset(buf, 0, 4096);
+  int have_avx = __builtin_cpu_supports("avx");
+
+  printf("# kernel cycles_per_access\n");
+  for (int k = 0; k < kNumKernels; k++) {
+    const struct Kernel *kernel = &kKernels[k];
+    if (!Selected(kernel->name, argc - optind, argv + optind))
+      continue;
+    if (kernel->needs_avx && !have_avx)
+      continue;
+    // Warm up, which also gets the code translated (and traced) by DR.
+    kernel->func(buf + kernel->offset, iters / 10 + 1);
+    unsigned long long best = 0;
+    for (int r = 0; r < reps; r++) {
+      unsigned long long start = __rdtsc();
+      kernel->func(buf + kernel->offset, iters);
+      unsigned long long cycles = __rdtsc() - start;
+      if (r == 0 || cycles < best)
+        best = cycles;
+    }
+    printf("%-20s %10.2f\n", kernel->name,
+           (double)best / ((double)iters * kernel->accesses));
+    fflush(stdout);
+  }
+  free(buf);
+  return 0;
+}
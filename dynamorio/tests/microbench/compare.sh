@@ -0,0 +1,68 @@
+#!/bin/bash
+# Runs the DrASan micro-benchmarks natively and under DrASan and prints the
+# cycles per access of every kernel in each configuration, and what a check
+# adds to it.
+# $ tests/microbench/compare.sh BUILD_DIR [kernel-prefix...]
+# BUILD_DIR is where cmake built drasan_bench and its kernels library.
+# DR       the folder with run.sh and libdr_asan.so (default: ../../dr)
+# CONFIGS  NAME:DRASAN_OPTIONS words, a column each, with commas for spaces,
+#          e.g. "inline: shared:-shared_checks,0 traces:-traces"
+#          (default "drasan:")
+# ITERS, REPS are handed over to drasan_bench.
+
+me=$(basename $0)
+if [ $# -lt 1 ]; then
+  echo >&2 "Usage: $me BUILD_DIR [kernel-prefix...]"
+  exit 1
+fi
+BENCH=$1/drasan_bench
+shift
+if [ ! -x $BENCH ]; then
+  echo >&2 "$me: no $BENCH, build it first"
+  exit 1
+fi
+DR=${DR:-$(dirname $0)/../../dr}
+CONFIGS=${CONFIGS:-drasan:}
+ARGS="-i ${ITERS:-1048576} -r ${REPS:-5} $@"
+
+OUT=$(mktemp -d)
+trap "rm -rf $OUT" EXIT
+
+$BENCH $ARGS > $OUT/native || exit 1
+NAMES=native
+for config in $CONFIGS; do
+  name=${config%%:*}
+  options=$(echo ${config#*:} | tr , ' ')
+  # The kernels library is not under /lib, ask for it explicitly.
+  DRASAN_OPTIONS="-instrument_module libdrasan_bench_kernels $options" \
+    $DR/run.sh -- $BENCH $ARGS > $OUT/$name || exit 1
+  NAMES="$NAMES $name"
+done
+
+# One column per configuration, then the cycles it adds to native.
+(cd $OUT && awk -v names="$NAMES" '
+  BEGIN { n = split(names, name, " ") }
+  /^#/ { next }
+  {
+    for (i = 1; i <= n; i++)
+      if (FILENAME == name[i]) cycles[$1, i] = $2
+    if (FILENAME == name[1]) order[++nk] = $1
+  }
+  END {
+    printf "%-20s", "kernel"
+    for (i = 1; i <= n; i++) printf " %10s", name[i]
+    for (i = 2; i <= n; i++) printf " %10s", "+" name[i]
+    printf "\n"
+    for (k = 1; k <= nk; k++) {
+      printf "%-20s", order[k]
+      for (i = 1; i <= n; i++)
+        printf " %10s", ((order[k], i) in cycles) ? cycles[order[k], i] : "-"
+      for (i = 2; i <= n; i++) {
+        added = "-"
+        if ((order[k], i) in cycles)
+          added = sprintf("%.2f", cycles[order[k], i] - cycles[order[k], 1])
+        printf " %10s", added
+      }
+      printf "\n"
+    }
+  }' $NAMES)
@@ -0,0 +1,145 @@
+// Access-shape kernels of the DrASan micro-benchmarks, see README.txt.
+// Built without ASan into a library of its own, so that the code under DR is
+// exactly the asm below: one loop per shape, 8 accesses per iteration, all
+// of them to the start of |buf| so that the cache never gets in the way.
+#include "kernels.h"
+
+#define REPEAT8(insn) insn insn insn insn insn insn insn insn
+
+// %0 is buf, %1 the iteration count; rcx is 0 for the indexed forms.
+#define KERNEL_WITH_EXIT(name, insn, exit)                               \
+  static void name(char *buf, long iters) {                              \
+    __asm__ volatile("xor %%ecx, %%ecx\n\t"                              \
+                     "1:\n\t"                                            \
+                     REPEAT8(insn "\n\t")                                \
+                     "dec %1\n\t"                                        \
+                     "jnz 1b\n\t"                                        \
+                     exit                                                \
+                     : "+r"(buf), "+r"(iters)                            \
+                     :                                                   \
+                     : "rax", "rcx", "xmm0", "memory", "cc");            \
+  }
+
+#define KERNEL(name, insn) KERNEL_WITH_EXIT(name, insn, "")
+// Leave no dirty upper halves behind to slow down the SSE kernels.
+#define KERNEL_AVX(name, insn) KERNEL_WITH_EXIT(name, insn, "vzeroupper\n\t")
+
+// Loads and stores of every size, addressed by the base alone.
+KERNEL(load1, "movzbl (%0), %%eax")
+KERNEL(load2, "movzwl (%0), %%eax")
+KERNEL(load4, "movl (%0), %%eax")
+KERNEL(load8, "movq (%0), %%rax")
+KERNEL(load16, "movdqu (%0), %%xmm0")
+KERNEL_AVX(load32, "vmovdqu (%0), %%ymm0")
+KERNEL(store1, "movb %%al, (%0)")
+KERNEL(store2, "movw %%ax, (%0)")
+KERNEL(store4, "movl %%eax, (%0)")
+KERNEL(store8, "movq %%rax, (%0)")
+KERNEL(store16, "movdqu %%xmm0, (%0)")
+KERNEL_AVX(store32, "vmovdqu %%ymm0, (%0)")
+
+// base+index*scale+disp: the address has to be computed into a register.
+KERNEL(load8_index, "movq 8(%0,%%rcx,8), %%rax")
+KERNEL(store8_index, "movq %%rax, 8(%0,%%rcx,8)")
+
+// A mov leaves the flags live across the check, so they are saved and
+// restored around it; an add overwrites them all and they are not.
+KERNEL(load8_flags_dead, "addq (%0), %%rax")
+
+static void rep_movsb256(char *buf, long iters) {
+  __asm__ volatile("1:\n\t"
+                   "mov %0, %%rsi\n\t"
+                   "lea 256(%0), %%rdi\n\t"
+                   "mov $256, %%ecx\n\t"
+                   "rep movsb\n\t"
+                   "dec %1\n\t"
+                   "jnz 1b\n\t"
+                   : "+r"(buf), "+r"(iters)
+                   :
+                   : "rcx", "rsi", "rdi", "memory", "cc");
+}
+
+static void rep_stosb256(char *buf, long iters) {
+  __asm__ volatile("xor %%eax, %%eax\n\t"
+                   "1:\n\t"
+                   "mov %0, %%rdi\n\t"
+                   "mov $256, %%ecx\n\t"
+                   "rep stosb\n\t"
+                   "dec %1\n\t"
+                   "jnz 1b\n\t"
+                   : "+r"(buf), "+r"(iters)
+                   :
+                   : "rax", "rcx", "rdi", "memory", "cc");
+}
+
+// Sums 64 vectors (1K) per iteration. The indexed loop has the shape
+// compilers emit for arrays, the pointer-bumping one the counted loop shape
+// that -traces checks once at loop entry.
+static void simd_sum_index(char *buf, long iters) {
+  __asm__ volatile("xorps %%xmm0, %%xmm0\n\t"
+                   "1:\n\t"
+                   "xor %%ecx, %%ecx\n\t"
+                   "2:\n\t"
+                   "movups (%0,%%rcx), %%xmm1\n\t"
+                   "addps %%xmm1, %%xmm0\n\t"
+                   "add $16, %%rcx\n\t"
+                   "cmp $1024, %%rcx\n\t"
+                   "jne 2b\n\t"
+                   "dec %1\n\t"
+                   "jnz 1b\n\t"
+                   : "+r"(buf), "+r"(iters)
+                   :
+                   : "rcx", "xmm0", "xmm1", "memory", "cc");
+}
+
+static void simd_sum_ptr(char *buf, long iters) {
+  __asm__ volatile("xorps %%xmm0, %%xmm0\n\t"
+                   "lea 1024(%0), %%rdx\n\t"
+                   "1:\n\t"
+                   "mov %0, %%rsi\n\t"
+                   "2:\n\t"
+                   "movups (%%rsi), %%xmm1\n\t"
+                   "addps %%xmm1, %%xmm0\n\t"
+                   "add $16, %%rsi\n\t"
+                   "cmp %%rdx, %%rsi\n\t"
+                   "jne 2b\n\t"
+                   "dec %1\n\t"
+                   "jnz 1b\n\t"
+                   : "+r"(buf), "+r"(iters)
+                   :
+                   : "rdx", "rsi", "xmm0", "xmm1", "memory", "cc");
+}
+
+const struct Kernel kKernels[] = {
+  { "load1", load1, 8, 0, 0 },
+  { "load2", load2, 8, 0, 0 },
+  { "load4", load4, 8, 0, 0 },
+  { "load8", load8, 8, 0, 0 },
+  { "load16", load16, 8, 0, 0 },
+  { "load32", load32, 8, 0, 1 },
+  { "load2_unaligned", load2, 8, 1, 0 },
+  { "load4_unaligned", load4, 8, 1, 0 },
+  { "load8_unaligned", load8, 8, 1, 0 },
+  { "load16_unaligned", load16, 8, 1, 0 },
+  { "load32_unaligned", load32, 8, 1, 1 },
+  { "store1", store1, 8, 0, 0 },
+  { "store2", store2, 8, 0, 0 },
+  { "store4", store4, 8, 0, 0 },
+  { "store8", store8, 8, 0, 0 },
+  { "store16", store16, 8, 0, 0 },
+  { "store32", store32, 8, 0, 1 },
+  { "store2_unaligned", store2, 8, 1, 0 },
+  { "store4_unaligned", store4, 8, 1, 0 },
+  { "store8_unaligned", store8, 8, 1, 0 },
+  { "store16_unaligned", store16, 8, 1, 0 },
+  { "store32_unaligned", store32, 8, 1, 1 },
+  { "load8_index", load8_index, 8, 0, 0 },
+  { "store8_index", store8_index, 8, 0, 0 },
+  { "load8_flags_dead", load8_flags_dead, 8, 0, 0 },
+  { "rep_movsb256", rep_movsb256, 1, 0, 0 },
+  { "rep_stosb256", rep_stosb256, 1, 0, 0 },
+  { "simd_sum_index", simd_sum_index, 64, 0, 0 },
+  { "simd_sum_ptr", simd_sum_ptr, 64, 0, 0 },
+};
+
+const int kNumKernels = sizeof(kKernels) / sizeof(kKernels[0]);
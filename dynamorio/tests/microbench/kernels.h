@@ -0,0 +1,29 @@
+// Access-shape kernels of the DrASan micro-benchmarks, see README.txt.
+#ifndef DRASAN_MICROBENCH_KERNELS_H
+#define DRASAN_MICROBENCH_KERNELS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Runs |iters| iterations of the kernel's access pattern on |buf|.
+typedef void (*KernelFunc)(char *buf, long iters);
+
+struct Kernel {
+  const char *name;
+  KernelFunc func;
+  // Instrumented memory accesses per iteration.
+  int accesses;
+  // Added to the buffer, 1 for the unaligned variants.
+  int offset;
+  int needs_avx;
+};
+
+extern const struct Kernel kKernels[];
+extern const int kNumKernels;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // DRASAN_MICROBENCH_KERNELS_H
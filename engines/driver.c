@@ -0,0 +1,196 @@
+// Driver of the engine comparison, see README.txt. Always built with
+// -fsanitize=address: it brings the ASan runtime that all engines report
+// through, the kernels library is what gets checked.
+//   engine_driver nop            exit right away, for the startup time
+//   engine_driver bench [SCALE]  run every kernel, print its time
+//   engine_driver bugs           list the seeded bugs
+//   engine_driver bug NAME       trigger one of them
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "kernels.h"
+
+static volatile long sink;
+
+static double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long Random(unsigned long *state) {
+  *state = *state * 6364136223846793005UL + 1442695040888963407UL;
+  return (long)(*state >> 33) + 1;
+}
+
+static struct HashTable NewTable(size_t size) {
+  struct HashTable t = { calloc(size, sizeof(long)), size - 1 };
+  return t;
+}
+
+static float *NewFloats(size_t n) {
+  float *v = malloc(n * sizeof(float));
+  for (size_t i = 0; i < n; i++)
+    v[i] = i % 7;
+  return v;
+}
+
+static void BenchStrings(int scale) {
+  enum { kStrings = 1000 };
+  unsigned long state = 1;
+  char *strings[kStrings], *copies[kStrings];
+  for (int i = 0; i < kStrings; i++) {
+    size_t len = Random(&state) % 200 + 1;
+    strings[i] = malloc(len + 1);
+    copies[i] = malloc(len + 1);
+    for (size_t j = 0; j < len; j++)
+      strings[i][j] = 'a' + Random(&state) % 26;
+    strings[i][len] = 0;
+  }
+  for (int r = 0; r < 500 * scale; r++) {
+    for (int i = 0; i < kStrings; i++) {
+      size_t len = k_strlen(strings[i]);
+      k_strcpy(copies[i], strings[i]);
+      sink += len + k_memcmp(copies[i], strings[i], len);
+    }
+  }
+  for (int i = 0; i < kStrings; i++) {
+    free(strings[i]);
+    free(copies[i]);
+  }
+}
+
+static void BenchHash(int scale) {
+  struct HashTable t = NewTable(1 << 16);
+  unsigned long state = 2;
+  for (int i = 0; i < 40000; i++)
+    k_hash_insert(&t, Random(&state));
+  for (int i = 0; i < 4000000 * scale; i++)
+    sink += k_hash_contains(&t, Random(&state));
+  free(t.slots);
+}
+
+static void BenchTree(int scale) {
+  enum { kNodes = 50000 };
+  struct Node **nodes = malloc(kNodes * sizeof(*nodes));
+  struct Node *root = NULL;
+  unsigned long state = 3;
+  for (int i = 0; i < kNodes; i++) {
+    nodes[i] = malloc(sizeof(struct Node));
+    nodes[i]->key = Random(&state);
+    root = k_tree_insert(root, nodes[i]);
+  }
+  for (int i = 0; i < 1000000 * scale; i++)
+    sink += k_tree_find(root, nodes[Random(&state) % kNodes]->key) != NULL;
+  for (int i = 0; i < kNodes; i++)
+    free(nodes[i]);
+  free(nodes);
+}
+
+static void BenchSimd(int scale) {
+  enum { kFloats = 4096 };
+  float *a = NewFloats(kFloats), *b = NewFloats(kFloats);
+  for (int i = 0; i < 200000 * scale; i++)
+    sink += k_dot(a, b, kFloats);
+  free(a);
+  free(b);
+}
+
+static void BugCopy() {
+  char *dst = malloc(16);
+  bug_copy_bounded(dst, 16, "0123456789abcdef");
+  free(dst);
+}
+
+static void BugHash() {
+  struct HashTable t = NewTable(64);
+  k_hash_insert(&t, 42);
+  sink += bug_hash_scan(&t, 43);
+  free(t.slots);
+}
+
+static void BugShift() {
+  char *s = strdup("xHELLO");
+  bug_shift_lower(s, 6);
+  free(s);
+}
+
+static void BugTree() {
+  struct Node *root = malloc(sizeof(struct Node));
+  struct Node *leaf = malloc(sizeof(struct Node));
+  root->key = 2;
+  leaf->key = 1;
+  root = k_tree_insert(NULL, root);
+  root = k_tree_insert(root, leaf);
+  free(leaf);  // Still linked into the tree.
+  sink += k_tree_find(root, 1) != NULL;
+  free(root);
+}
+
+static void BugSimd() {
+  float *a = NewFloats(4093), *b = NewFloats(4093);
+  sink += bug_dot_no_tail(a, b, 4093);
+  free(a);
+  free(b);
+}
+
+struct Case {
+  const char *name;
+  void (*run)(int scale);
+};
+
+static const struct Case kBenches[] = {
+  { "strings", BenchStrings },
+  { "hash", BenchHash },
+  { "tree", BenchTree },
+  { "simd", BenchSimd },
+};
+
+struct Bug {
+  const char *name;
+  void (*run)();
+};
+
+static const struct Bug kBugs[] = {
+  { "heap-overflow-write", BugCopy },
+  { "heap-overflow-read", BugHash },
+  { "heap-underflow-write", BugShift },
+  { "use-after-free", BugTree },
+  { "simd-overread", BugSimd },
+};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+int main(int argc, char **argv) {
+  if (argc >= 2 && strcmp(argv[1], "nop") == 0)
+    return 0;
+  if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+    int scale = argc >= 3 ? atoi(argv[2]) : 1;
+    for (size_t i = 0; i < ARRAY_SIZE(kBenches); i++) {
+      double start = Now();
+      kBenches[i].run(scale);
+      printf("%s %.3f\n", kBenches[i].name, Now() - start);
+    }
+    return 0;
+  }
+  if (argc == 2 && strcmp(argv[1], "bugs") == 0) {
+    for (size_t i = 0; i < ARRAY_SIZE(kBugs); i++)
+      printf("%s\n", kBugs[i].name);
+    return 0;
+  }
+  if (argc == 3 && strcmp(argv[1], "bug") == 0) {
+    for (size_t i = 0; i < ARRAY_SIZE(kBugs); i++) {
+      if (strcmp(argv[2], kBugs[i].name) == 0) {
+        kBugs[i].run();
+        // Only reached if the engine missed it.
+        printf("%s: not detected\n", kBugs[i].name);
+        return 0;
+      }
+    }
+  }
+  fprintf(stderr, "Usage: %s nop | bench [SCALE] | bugs | bug NAME\n",
+          argv[0]);
+  return 1;
+}
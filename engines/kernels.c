@@ -0,0 +1,108 @@
+// Kernels of the engine comparison, see README.txt. Built twice: plain, to
+// be checked by DrASan and the Pin tool, and with -fsanitize=address.
+#include <xmmintrin.h>
+
+#include "kernels.h"
+
+size_t k_strlen(const char *s) {
+  const char *p = s;
+  while (*p)
+    p++;
+  return p - s;
+}
+
+char *k_strcpy(char *dst, const char *src) {
+  char *d = dst;
+  while ((*d++ = *src++) != 0) {}
+  return dst;
+}
+
+int k_memcmp(const void *a, const void *b, size_t n) {
+  const unsigned char *x = a, *y = b;
+  for (size_t i = 0; i < n; i++) {
+    if (x[i] != y[i])
+      return x[i] < y[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+static size_t Hash(long key) {
+  return (unsigned long)key * 0x9E3779B97F4A7C15UL >> 17;
+}
+
+void k_hash_insert(struct HashTable *t, long key) {
+  size_t i = Hash(key) & t->mask;
+  while (t->slots[i] != 0 && t->slots[i] != key)
+    i = (i + 1) & t->mask;
+  t->slots[i] = key;
+}
+
+int k_hash_contains(const struct HashTable *t, long key) {
+  for (size_t i = Hash(key) & t->mask; t->slots[i] != 0;
+       i = (i + 1) & t->mask) {
+    if (t->slots[i] == key)
+      return 1;
+  }
+  return 0;
+}
+
+struct Node *k_tree_insert(struct Node *root, struct Node *node) {
+  node->left = node->right = 0;
+  if (!root)
+    return node;
+  struct Node *n = root;
+  for (;;) {
+    struct Node **next = node->key < n->key ? &n->left : &n->right;
+    if (!*next) {
+      *next = node;
+      return root;
+    }
+    n = *next;
+  }
+}
+
+struct Node *k_tree_find(struct Node *root, long key) {
+  while (root && root->key != key)
+    root = key < root->key ? root->left : root->right;
+  return root;
+}
+
+float k_dot(const float *a, const float *b, size_t n) {
+  __m128 sum = _mm_setzero_ps();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+  float lanes[4];
+  _mm_storeu_ps(lanes, sum);
+  float result = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  for (; i < n; i++)
+    result += a[i] * b[i];
+  return result;
+}
+
+void bug_copy_bounded(char *dst, size_t cap, const char *src) {
+  if (k_strlen(src) <= cap)  // Should be <, the terminator needs a byte.
+    k_strcpy(dst, src);
+}
+
+int bug_hash_scan(const struct HashTable *t, long key) {
+  for (size_t i = 0; i <= t->mask + 1; i++) {  // One slot too many.
+    if (t->slots[i] == key)
+      return 1;
+  }
+  return 0;
+}
+
+void bug_shift_lower(char *s, size_t n) {
+  for (long i = 0; i < (long)n; i++)
+    s[i - 1] = s[i] | 0x20;  // Should start at 1.
+}
+
+float bug_dot_no_tail(const float *a, const float *b, size_t n) {
+  __m128 sum = _mm_setzero_ps();
+  for (size_t i = 0; i < n; i += 4)  // Should stop at the last full vector.
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+  float lanes[4];
+  _mm_storeu_ps(lanes, sum);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
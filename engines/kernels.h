@@ -0,0 +1,44 @@
+// Kernels of the engine comparison, see README.txt.
+#ifndef ENGINE_KERNELS_H
+#define ENGINE_KERNELS_H
+
+#include <stddef.h>
+
+struct HashTable {
+  long *slots;  // 0 is a free slot.
+  size_t mask;  // The number of slots minus one, a power of two minus one.
+};
+
+struct Node {
+  long key;
+  struct Node *left;
+  struct Node *right;
+};
+
+// String operations, byte at a time like the generic ones of a libc.
+size_t k_strlen(const char *s);
+char *k_strcpy(char *dst, const char *src);
+int k_memcmp(const void *a, const void *b, size_t n);
+
+// Open addressing with linear probing; keys are non-zero.
+void k_hash_insert(struct HashTable *t, long key);
+int k_hash_contains(const struct HashTable *t, long key);
+
+// Unbalanced binary search tree of caller-allocated nodes.
+struct Node *k_tree_insert(struct Node *root, struct Node *node);
+struct Node *k_tree_find(struct Node *root, long key);
+
+// SSE dot product.
+float k_dot(const float *a, const float *b, size_t n);
+
+// Seeded bugs, one for every kind of error the engines should find.
+// Writes dst[cap] when strlen(src) == cap.
+void bug_copy_bounded(char *dst, size_t cap, const char *src);
+// Reads one slot past the table when key is absent.
+int bug_hash_scan(const struct HashTable *t, long key);
+// Drops the first character and lowercases the rest, but writes s[-1].
+void bug_shift_lower(char *s, size_t n);
+// Reads up to 3 floats past the arrays when n % 4 != 0.
+float bug_dot_no_tail(const float *a, const float *b, size_t n);
+
+#endif  // ENGINE_KERNELS_H
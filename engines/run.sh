@@ -0,0 +1,161 @@
+#!/bin/bash
+# Compares the three ways of checking a library that isn't built with ASan:
+# compiler ASan (rebuilding it), DrASan and the Pin tool, on the kernels of
+# kernels.c. See README.txt.
+# $ ./run.sh
+# CC       the compiler, must support -fsanitize=address (default clang)
+# DR       the DynamoRIO folder with run.sh and libdr_asan.so, as set up by
+#          dynamorio/README.txt (default ../dynamorio/dr)
+# PIN      the Pin folder, PIN_TOOL the asan_pin.so built in it
+#          (see pin/README.txt)
+# ENGINES  engines to run (default: native asan drasan pin); drasan and pin
+#          are skipped if they aren't set up
+# SCALE    size of the bench workload (default 1)
+# REPS     runs of every measurement, the median is kept (default 3)
+# OUT      where the builds, logs, results.csv and table.txt go
+#          (default engines-out)
+
+me=$(basename $0)
+SRC=$(cd $(dirname $0) && pwd)
+CC=${CC:-clang}
+DR=${DR:-$SRC/../dynamorio/dr}
+ENGINES=${ENGINES:-native asan drasan pin}
+SCALE=${SCALE:-1}
+REPS=${REPS:-3}
+OUT=${OUT:-engines-out}
+
+rm -rf $OUT
+mkdir -p $OUT/plain $OUT/asan $OUT/logs
+OUT=$(cd $OUT && pwd)
+BIN=$OUT/engine_driver
+
+CFLAGS="-std=gnu99 -O2 -g -fno-omit-frame-pointer"
+$CC $CFLAGS -fPIC -shared $SRC/kernels.c -o $OUT/plain/libengine_kernels.so &&
+$CC $CFLAGS -fPIC -shared -fsanitize=address $SRC/kernels.c \
+  -o $OUT/asan/libengine_kernels.so &&
+$CC $CFLAGS -fsanitize=address $SRC/driver.c -L$OUT/plain -lengine_kernels \
+  -o $BIN || exit 1
+
+# run_engine [-t LOG] ENGINE ARGS...: the driver under ENGINE. Only asan gets
+# the ASan build of the kernels. -t appends the elapsed time and peak RSS to
+# LOG. /usr/bin/time goes in front of the engine's launcher: behind it, time
+# would be the program DrASan or Pin instruments and the driver only its
+# child.
+run_engine() {
+  local timer=()
+  if [ "$1" == "-t" ]; then
+    timer=(/usr/bin/time -f "%e %M" -a -o $2)
+    shift 2
+  fi
+  local engine=$1
+  shift
+  case $engine in
+    native)
+      LD_LIBRARY_PATH=$OUT/plain "${timer[@]}" "$@"
+      ;;
+    asan)
+      LD_LIBRARY_PATH=$OUT/asan "${timer[@]}" "$@"
+      ;;
+    drasan)
+      # The kernels are not under /lib, ask for them explicitly.
+      LD_LIBRARY_PATH=$OUT/plain \
+        DRASAN_OPTIONS="-instrument_module libengine_kernels $DRASAN_OPTIONS" \
+        "${timer[@]}" $DR/run.sh -- "$@"
+      ;;
+    pin)
+      LD_LIBRARY_PATH=$OUT/plain \
+        "${timer[@]}" $PIN/pin -t $PIN_TOOL -policy full:libengine_kernels \
+        -- "$@"
+      ;;
+  esac
+}
+
+RUN_ENGINES=
+for engine in $ENGINES; do
+  case $engine in
+    native|asan)
+      ;;
+    drasan)
+      if [ ! -x $DR/run.sh ]; then
+        echo >&2 "$me: no $DR/run.sh, skipping drasan"
+        continue
+      fi
+      ;;
+    pin)
+      if [ ! -x "$PIN/pin" -o ! -f "$PIN_TOOL" ]; then
+        echo >&2 "$me: PIN and PIN_TOOL not set up, skipping pin"
+        continue
+      fi
+      ;;
+    *)
+      echo >&2 "$me: unknown engine $engine"
+      exit 1
+      ;;
+  esac
+  RUN_ENGINES="$RUN_ENGINES $engine"
+done
+
+BUGS=$(LD_LIBRARY_PATH=$OUT/plain $BIN bugs)
+NUM_BUGS=$(echo $BUGS | wc -w)
+
+median() {
+  tr ' ' '\n' | sort -n | awk '{ v[NR] = $1 }
+    END { print NR % 2 ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2 }'
+}
+
+# results.csv: one row per engine, kernels.csv: one per (engine, kernel).
+echo "engine,startup_s,bench_s,maxrss_kb,detected,bugs" > $OUT/results.csv
+echo "engine,kernel,seconds" > $OUT/kernels.csv
+for engine in $RUN_ENGINES; do
+  echo "$me: $engine"
+  log=$OUT/logs/$engine
+  for ((rep = 0; rep < REPS; rep++)); do
+    run_engine -t $log.startup $engine $BIN nop 2>> $log.err
+    run_engine -t $log.time $engine $BIN bench $SCALE \
+      >> $log.bench 2>> $log.err
+  done
+  detected=0
+  for bug in $BUGS; do
+    run_engine $engine $BIN bug $bug > $log.bug-$bug 2>&1
+    if grep -q "ERROR: AddressSanitizer" $log.bug-$bug; then
+      detected=$((detected + 1))
+    fi
+  done
+  startup=$(awk 'NF == 2 { print $1 }' $log.startup | median)
+  bench=$(awk 'NF == 2 { print $1 }' $log.time | median)
+  rss=$(awk 'NF == 2 { print $2 }' $log.time | median)
+  echo "$engine,$startup,$bench,$rss,$detected,$NUM_BUGS" >> $OUT/results.csv
+  for kernel in $(awk '{ print $1 }' $log.bench | sort -u); do
+    echo "$engine,$kernel,$(awk -v k=$kernel '$1 == k { print $2 }' \
+      $log.bench | median)" >> $OUT/kernels.csv
+  done
+done
+
+# The table compares every engine with native: the overall and per-kernel
+# slowdowns, peak RSS and startup time.
+awk -F, '
+  FNR == 1 { file++; next }
+  file == 1 {
+    engines[++ne] = $1
+    startup[$1] = $2; bench[$1] = $3; rss[$1] = $4; found[$1] = $5 "/" $6
+  }
+  file == 2 {
+    if (!($2 in seen)) { seen[$2] = 1; kernels[++nk] = $2 }
+    t[$1, $2] = $3
+  }
+  function ratio(x, base) { return base > 0 ? sprintf("%.2f", x / base) : "-" }
+  END {
+    printf "%-8s %9s %9s %9s %9s %8s", "engine", "startup_s", "bench_s",
+           "slowdown", "mem_x", "detected"
+    for (k = 1; k <= nk; k++) printf " %9s", kernels[k] "_x"
+    printf "\n"
+    for (e = 1; e <= ne; e++) {
+      n = engines[e]
+      printf "%-8s %9.2f %9.2f %9s %9s %8s", n, startup[n], bench[n],
+             ratio(bench[n], bench["native"]), ratio(rss[n], rss["native"]),
+             found[n]
+      for (k = 1; k <= nk; k++)
+        printf " %9s", ratio(t[n, kernels[k]], t["native", kernels[k]])
+      printf "\n"
+    }
+  }' $OUT/results.csv $OUT/kernels.csv | tee $OUT/table.txt
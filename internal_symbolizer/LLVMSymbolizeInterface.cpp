@@ -1,6 +1,19 @@
 #include "LLVMSymbolize.h"
+#include "SymbolIndex.h"
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
 #include <string>
+#include <vector>
 
 /* C interface for LLVMSymbolize library */
 
@@ -16,6 +29,272 @@ static llvm::symbolize::LLVMSymbolizer *getDefaultSymbolizer() {
   return DefaultSymbolizer;
 }
 
+/* Symbolization server (see symbolizer_server.cpp). When
+   SANITIZER_SYMBOLIZER_SOCKET names the socket of a running server, requests
+   go there and share its cache with the other processes of the host. Without
+   a server, or once it has failed us, they are served in-process. */
+
+static const char kServerSocketEnv[] = "SANITIZER_SYMBOLIZER_SOCKET";
+// We are on the crash path: a server that takes longer than this to answer
+// is given up on, and the report symbolized in-process.
+static const int kServerTimeoutSeconds = 3;
+// Requests go out this many at a time, each batch in one write. The server
+// answers while it reads, so the replies of a batch must fit in the socket
+// buffer until we get to read them.
+static const size_t kMaxServerBatch = 64;
+
+static int ServerFd = -1;
+static pid_t ServerPid = 0;
+static bool ServerDisabled = false;
+
+static void disconnectServer() {
+  if (ServerFd >= 0)
+    close(ServerFd);
+  ServerFd = -1;
+  ServerDisabled = true;
+}
+
+static bool connectServer() {
+  // A child inherits the connection of its parent, and their requests would
+  // interleave on it: it gets a connection of its own.
+  if (ServerFd >= 0 && ServerPid == getpid())
+    return true;
+  if (ServerFd >= 0) {
+    close(ServerFd);
+    ServerFd = -1;
+    ServerDisabled = false;
+  }
+  const char *Path = getenv(kServerSocketEnv);
+  // The server always demangles.
+  if (ServerDisabled || !Path || !*Path || !DemangleEnabled)
+    return false;
+  struct sockaddr_un Addr;
+  if (strlen(Path) >= sizeof(Addr.sun_path)) {
+    ServerDisabled = true;
+    return false;
+  }
+  memset(&Addr, 0, sizeof(Addr));
+  Addr.sun_family = AF_UNIX;
+  strcpy(Addr.sun_path, Path);
+  ServerFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct timeval Timeout = { kServerTimeoutSeconds, 0 };
+  if (ServerFd < 0 ||
+      setsockopt(ServerFd, SOL_SOCKET, SO_RCVTIMEO, &Timeout,
+                 sizeof(Timeout)) != 0 ||
+      setsockopt(ServerFd, SOL_SOCKET, SO_SNDTIMEO, &Timeout,
+                 sizeof(Timeout)) != 0 ||
+      connect(ServerFd, (struct sockaddr *)&Addr, sizeof(Addr)) != 0) {
+    disconnectServer();
+    return false;
+  }
+  ServerPid = getpid();
+  return true;
+}
+
+// CODE|DATA <hex offset> <module>\n, or "" if the module name can't be sent.
+// The server resolves paths in its own working directory, so a relative one
+// is made absolute here.
+static std::string serverRequest(const char *Kind, const char *ModuleName,
+                                 uint64_t ModuleOffset) {
+  char Resolved[PATH_MAX];
+  if (ModuleName[0] != '/') {
+    if (!realpath(ModuleName, Resolved))
+      return std::string();
+    ModuleName = Resolved;
+  }
+  if (strchr(ModuleName, '\n'))
+    return std::string();
+  char Prefix[64];
+  snprintf(Prefix, sizeof(Prefix), "%s 0x%llx ", Kind,
+           (unsigned long long)ModuleOffset);
+  return std::string(Prefix) + ModuleName + "\n";
+}
+
+// Sends the request lines in one write and reads their NUL-terminated
+// replies, which come back in order. Any failure drops the server for the
+// rest of the process.
+static bool requestServer(const std::vector<std::string> &Requests,
+                          std::vector<std::string> *Replies) {
+  if (!connectServer())
+    return false;
+  std::string Data;
+  for (size_t I = 0; I < Requests.size(); ++I)
+    Data += Requests[I];
+  for (size_t Sent = 0; Sent < Data.size();) {
+    // MSG_NOSIGNAL: a dead server must not SIGPIPE the process.
+    ssize_t N = send(ServerFd, Data.data() + Sent, Data.size() - Sent,
+                     MSG_NOSIGNAL);
+    if (N <= 0) {
+      disconnectServer();
+      return false;
+    }
+    Sent += N;
+  }
+  Replies->clear();
+  std::string Reply;
+  char Chunk[4096];
+  while (Replies->size() < Requests.size() || !Reply.empty()) {
+    ssize_t N = recv(ServerFd, Chunk, sizeof(Chunk), 0);
+    if (N <= 0) {
+      disconnectServer();
+      return false;
+    }
+    for (ssize_t I = 0; I < N; I++) {
+      if (Chunk[I] != '\0') {
+        Reply += Chunk[I];
+        continue;
+      }
+      Replies->push_back(Reply);
+      Reply.clear();
+    }
+    // More replies than requests: we are out of step with the server.
+    if (Replies->size() > Requests.size()) {
+      disconnectServer();
+      return false;
+    }
+  }
+  return true;
+}
+
+static void symbolizeCodeInProcess(const char *ModuleName,
+                                   uint64_t ModuleOffset, char *Buffer,
+                                   int MaxLength) {
+  std::string Result = getDefaultSymbolizer()->symbolizeCode(ModuleName,
+                                                             ModuleOffset);
+  snprintf(Buffer, MaxLength, "%s", Result.c_str());
+}
+
+// Frames in an index are answered from it, the others go to the server in
+// batches, and what the server can't answer is symbolized in-process.
+static void symbolizeCodeBatch(int Count, const char *const *ModuleNames,
+                               const uint64_t *ModuleOffsets,
+                               char *const *Buffers, int MaxLength) {
+  std::vector<int> Pending;
+  for (int I = 0; I < Count; ++I) {
+    // Indices hold demangled names.
+    const symbol_index::SymbolIndex *Index =
+        DemangleEnabled ? symbol_index::findSymbolIndex(ModuleNames[I]) : 0;
+    std::string Indexed;
+    if (Index && Index->symbolizeCode(ModuleOffsets[I], &Indexed))
+      snprintf(Buffers[I], MaxLength, "%s", Indexed.c_str());
+    else
+      Pending.push_back(I);
+  }
+  std::vector<std::string> Requests, Replies;
+  std::vector<int> Sent;
+  for (size_t Start = 0; Start < Pending.size(); Start += kMaxServerBatch) {
+    size_t End = std::min(Pending.size(), Start + kMaxServerBatch);
+    Requests.clear();
+    Sent.clear();
+    for (size_t P = Start; P < End; ++P) {
+      int I = Pending[P];
+      std::string Request =
+          serverRequest("CODE", ModuleNames[I], ModuleOffsets[I]);
+      if (Request.empty()) {
+        symbolizeCodeInProcess(ModuleNames[I], ModuleOffsets[I], Buffers[I],
+                               MaxLength);
+        continue;
+      }
+      Requests.push_back(Request);
+      Sent.push_back(I);
+    }
+    bool Served = !Requests.empty() && requestServer(Requests, &Replies);
+    for (size_t R = 0; R < Sent.size(); ++R) {
+      int I = Sent[R];
+      if (Served)
+        snprintf(Buffers[I], MaxLength, "%s", Replies[R].c_str());
+      else
+        symbolizeCodeInProcess(ModuleNames[I], ModuleOffsets[I], Buffers[I],
+                               MaxLength);
+    }
+  }
+}
+
+/* Warm-up (__llvm_symbolize_warm_up). A background thread symbolizes one
+   address of each queued module, which makes the symbolizer (or the server)
+   load the module and build its address index, so that the first report only
+   has lookups left to do. SymbolizerLock serializes it with the requests,
+   and is held for one lookup batch at a time: a report that comes in the
+   middle waits for the module being loaded at most, and the thread doesn't
+   take the lock again while a report is waiting for it. */
+
+static pthread_mutex_t SymbolizerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t WarmUpLock = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<std::string> *WarmUpQueue;
+static bool WarmUpThreadRunning = false;
+static int ReportsWaiting = 0;
+
+// SymbolizerLock isn't recursive. A thread that faults while holding it, e.g.
+// the warm-up thread loading a module, comes back here from its error report:
+// that report gets no symbols rather than deadlocking.
+static __thread bool HoldsSymbolizerLock = false;
+
+static bool lockSymbolizer() {
+  if (HoldsSymbolizerLock)
+    return false;
+  __sync_fetch_and_add(&ReportsWaiting, 1);
+  pthread_mutex_lock(&SymbolizerLock);
+  __sync_fetch_and_sub(&ReportsWaiting, 1);
+  HoldsSymbolizerLock = true;
+  return true;
+}
+
+static void unlockSymbolizer() {
+  HoldsSymbolizerLock = false;
+  pthread_mutex_unlock(&SymbolizerLock);
+}
+
+static void *warmUpThread(void *) {
+  // Only use the CPU time nobody else wants.
+  // On Linux, 0 is the calling thread, not the whole process.
+  setpriority(PRIO_PROCESS, 0, 19);
+  for (;;) {
+    pthread_mutex_lock(&WarmUpLock);
+    if (WarmUpQueue->empty()) {
+      WarmUpThreadRunning = false;
+      pthread_mutex_unlock(&WarmUpLock);
+      return 0;
+    }
+    std::string Module = WarmUpQueue->front();
+    WarmUpQueue->erase(WarmUpQueue->begin());
+    pthread_mutex_unlock(&WarmUpLock);
+
+    // Let the reports go first.
+    while (__sync_fetch_and_add(&ReportsWaiting, 0) > 0)
+      sched_yield();
+    pthread_mutex_lock(&SymbolizerLock);
+    HoldsSymbolizerLock = true;
+    // A module with an index has nothing to warm up.
+    if (!DemangleEnabled || !symbol_index::findSymbolIndex(Module.c_str())) {
+      char Buffer[4096];
+      char *Buffers[] = { Buffer };
+      const char *Modules[] = { Module.c_str() };
+      const uint64_t Offsets[] = { 0 };
+      symbolizeCodeBatch(1, Modules, Offsets, Buffers, sizeof(Buffer));
+    }
+    unlockSymbolizer();
+  }
+}
+
+// The warm-up thread doesn't survive fork, and the child must not inherit
+// locks it held.
+static void lockForFork() {
+  pthread_mutex_lock(&WarmUpLock);
+  pthread_mutex_lock(&SymbolizerLock);
+}
+
+static void unlockAfterFork() {
+  pthread_mutex_unlock(&SymbolizerLock);
+  pthread_mutex_unlock(&WarmUpLock);
+}
+
+static void resetInChild() {
+  pthread_mutex_init(&SymbolizerLock, 0);
+  pthread_mutex_init(&WarmUpLock, 0);
+  WarmUpQueue->clear();
+  WarmUpThreadRunning = false;
+}
+
 extern "C" {
 
 // Must be called before the first call to __llvm_symbolize_*
@@ -27,24 +306,86 @@ void __llvm_symbolize_set_demangling(bool DoDemangle) {
 __attribute__((visibility("default")))
 bool __llvm_symbolize_code(const char *ModuleName, uint64_t ModuleOffset,
                            char *Buffer, int MaxLength) {
-  std::string Result = getDefaultSymbolizer()->symbolizeCode(ModuleName,
-                                                             ModuleOffset);
-  snprintf(Buffer, MaxLength, "%s", Result.c_str());
+  if (!lockSymbolizer())
+    return false;
+  symbolizeCodeBatch(1, &ModuleName, &ModuleOffset, &Buffer, MaxLength);
+  unlockSymbolizer();
+  return true;
+}
+
+// Symbolizes Count code addresses at once, Buffers[I] getting what
+// __llvm_symbolize_code writes for ModuleNames[I] and ModuleOffsets[I]. For
+// the frames of a report: a server gets them in a few writes and round trips
+// rather than one per frame.
+__attribute__((visibility("default")))
+bool __llvm_symbolize_code_batch(int Count, const char *const *ModuleNames,
+                                 const uint64_t *ModuleOffsets,
+                                 char *const *Buffers, int MaxLength) {
+  if (!lockSymbolizer())
+    return false;
+  symbolizeCodeBatch(Count, ModuleNames, ModuleOffsets, Buffers, MaxLength);
+  unlockSymbolizer();
   return true;
 }
 
 __attribute__((visibility("default")))
 bool __llvm_symbolize_data(const char *ModuleName, uint64_t ModuleOffset,
                            char *Buffer, int MaxLength) {
-  std::string Result = getDefaultSymbolizer()->symbolizeData(ModuleName,
-                                                             ModuleOffset);
-  snprintf(Buffer, MaxLength, "%s", Result.c_str());
+  if (!lockSymbolizer())
+    return false;
+  std::string Request = serverRequest("DATA", ModuleName, ModuleOffset);
+  std::vector<std::string> Requests(1, Request), Replies;
+  if (!Request.empty() && requestServer(Requests, &Replies)) {
+    snprintf(Buffer, MaxLength, "%s", Replies[0].c_str());
+  } else {
+    std::string Result = getDefaultSymbolizer()->symbolizeData(ModuleName,
+                                                               ModuleOffset);
+    snprintf(Buffer, MaxLength, "%s", Result.c_str());
+  }
+  unlockSymbolizer();
   return true;
 }
 
+// The server's cache is shared and stays warm, only ours is flushed.
 __attribute__((visibility("default")))
 void __llvm_symbolize_flush() {
+  if (!lockSymbolizer())
+    return;
   getDefaultSymbolizer()->flush();
+  unlockSymbolizer();
+}
+
+// Queues ModuleName for the low-priority warm-up thread, starting it if
+// needed, and returns right away. For the runtime to call at startup or when
+// a module is loaded; modules nobody asks to warm up are loaded at the first
+// report, as before. False if the thread can't be started.
+__attribute__((visibility("default")))
+bool __llvm_symbolize_warm_up(const char *ModuleName) {
+  static pthread_once_t Once = PTHREAD_ONCE_INIT;
+  struct Init {
+    static void run() {
+      WarmUpQueue = new std::vector<std::string>;
+      pthread_atfork(lockForFork, unlockAfterFork, resetInChild);
+    }
+  };
+  pthread_once(&Once, Init::run);
+  pthread_mutex_lock(&WarmUpLock);
+  WarmUpQueue->push_back(ModuleName);
+  bool Ok = true;
+  if (!WarmUpThreadRunning) {
+    pthread_attr_t Attr;
+    pthread_attr_init(&Attr);
+    pthread_attr_setdetachstate(&Attr, PTHREAD_CREATE_DETACHED);
+    pthread_t Thread;
+    Ok = pthread_create(&Thread, &Attr, warmUpThread, 0) == 0;
+    pthread_attr_destroy(&Attr);
+    if (Ok)
+      WarmUpThreadRunning = true;
+    else
+      WarmUpQueue->pop_back();
+  }
+  pthread_mutex_unlock(&WarmUpLock);
+  return Ok;
 }
 
 __attribute__((visibility("default")))
@@ -1,7 +1,9 @@
 #include <fcntl.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 namespace __sanitizer {
@@ -69,6 +71,40 @@ void *mmap(void *addr, size_t length, int prot, int flags, int fd,
                                     fd, (unsigned long long) offset);
 }
 
+// The symbolization server client talks over a socket. sanitizer_common has
+// no internal socket functions and not every tool intercepts them, so make
+// the system calls ourselves (the i386 ones need Linux 4.3; with an older
+// kernel they fail and the symbolizer works in-process).
+
+int socket(int domain, int type, int protocol) {
+  return syscall(SYS_socket, domain, type, protocol);
+}
+
+int connect(int fd, const struct sockaddr *addr, socklen_t addrlen) {
+  return syscall(SYS_connect, fd, addr, addrlen);
+}
+
+int setsockopt(int fd, int level, int optname, const void *optval,
+               socklen_t optlen) {
+  return syscall(SYS_setsockopt, fd, level, optname, optval, optlen);
+}
+
+ssize_t send(int fd, const void *buf, size_t len, int flags) {
+  return syscall(SYS_sendto, fd, buf, len, flags, 0, 0);
+}
+
+ssize_t recv(int fd, void *buf, size_t len, int flags) {
+  return syscall(SYS_recvfrom, fd, buf, len, flags, 0, 0);
+}
+
+// Likewise for the scheduling calls of the warm-up thread.
+
+int setpriority(int which, id_t who, int prio) {
+  return syscall(SYS_setpriority, which, who, prio);
+}
+
+int sched_yield() { return syscall(SYS_sched_yield); }
+
 // Redirect some functions to sanitizer interceptors.
 
 ssize_t __interceptor_read(int fd, void *ptr, size_t count);
@@ -79,6 +115,8 @@ int __interceptor_pthread_cond_broadcast(void *c);
 int __interceptor_pthread_cond_wait(void *c, void *m);
 int __interceptor_pthread_mutex_lock(void *m);
 int __interceptor_pthread_mutex_unlock(void *m);
+int __interceptor_pthread_create(void *th, void *attr,
+                                 void *(*callback)(void *), void *param);
 
 ssize_t read(int fd, void *ptr, size_t count) {
   return __interceptor_read(fd, ptr, count);
@@ -104,6 +142,10 @@ int pthread_mutex_lock(void *m) {
 int pthread_mutex_unlock(void *m) {
   return __interceptor_pthread_mutex_unlock(m);
 }
+int pthread_create(void *th, void *attr, void *(*callback)(void *),
+                   void *param) {
+  return __interceptor_pthread_create(th, attr, callback, param);
+}
 
 }  // extern "C"
 
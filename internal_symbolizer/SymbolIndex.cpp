@@ -0,0 +1,227 @@
+// Reader of the symbol index format, see SymbolIndex.h.
+
+#include "SymbolIndex.h"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+
+namespace symbol_index {
+
+namespace {
+
+// Maps the whole file read-only. 0 if it can't be.
+const char *mapFile(const char *Path, size_t *Size) {
+  int Fd = open(Path, O_RDONLY);
+  if (Fd < 0)
+    return 0;
+  struct stat St;
+  if (fstat(Fd, &St) != 0 || St.st_size == 0) {
+    close(Fd);
+    return 0;
+  }
+  void *Map = mmap(0, St.st_size, PROT_READ, MAP_PRIVATE, Fd, 0);
+  close(Fd);
+  if (Map == MAP_FAILED)
+    return 0;
+  *Size = St.st_size;
+  return static_cast<const char *>(Map);
+}
+
+template <class Nhdr>
+bool findBuildIdNote(const char *Notes, size_t Size, std::string *BuildId) {
+  size_t Pos = 0;
+  while (Pos + sizeof(Nhdr) <= Size) {
+    const Nhdr *Note = reinterpret_cast<const Nhdr *>(Notes + Pos);
+    size_t NameSize = (Note->n_namesz + 3) & ~3UL;
+    size_t DescSize = (Note->n_descsz + 3) & ~3UL;
+    size_t Desc = Pos + sizeof(Nhdr) + NameSize;
+    if (Desc + DescSize > Size)
+      return false;
+    if (Note->n_type == NT_GNU_BUILD_ID && Note->n_namesz == 4 &&
+        memcmp(Notes + Pos + sizeof(Nhdr), "GNU", 4) == 0) {
+      BuildId->assign(Notes + Desc, Note->n_descsz);
+      return true;
+    }
+    Pos = Desc + DescSize;
+  }
+  return false;
+}
+
+// The note is in a PT_NOTE segment, and an SHT_NOTE section of files that
+// have no program headers (separate debug files).
+template <class Ehdr, class Phdr, class Shdr, class Nhdr>
+bool readElfBuildId(const char *Base, size_t Size, std::string *BuildId) {
+  const Ehdr *Header = reinterpret_cast<const Ehdr *>(Base);
+  if (Size < sizeof(Ehdr))
+    return false;
+  if (Header->e_phoff + Header->e_phnum * sizeof(Phdr) <= Size) {
+    const Phdr *Segments =
+        reinterpret_cast<const Phdr *>(Base + Header->e_phoff);
+    for (unsigned I = 0; I < Header->e_phnum; ++I) {
+      if (Segments[I].p_type == PT_NOTE &&
+          Segments[I].p_offset + Segments[I].p_filesz <= Size &&
+          findBuildIdNote<Nhdr>(Base + Segments[I].p_offset,
+                                Segments[I].p_filesz, BuildId))
+        return true;
+    }
+  }
+  if (Header->e_shoff + Header->e_shnum * sizeof(Shdr) <= Size) {
+    const Shdr *Sections =
+        reinterpret_cast<const Shdr *>(Base + Header->e_shoff);
+    for (unsigned I = 0; I < Header->e_shnum; ++I) {
+      if (Sections[I].sh_type == SHT_NOTE &&
+          Sections[I].sh_offset + Sections[I].sh_size <= Size &&
+          findBuildIdNote<Nhdr>(Base + Sections[I].sh_offset,
+                                Sections[I].sh_size, BuildId))
+        return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+bool readBuildId(const char *Path, std::string *BuildId) {
+  size_t Size;
+  const char *Map = mapFile(Path, &Size);
+  if (!Map)
+    return false;
+  bool Ok = false;
+  if (Size >= EI_NIDENT && memcmp(Map, ELFMAG, SELFMAG) == 0) {
+    if (Map[EI_CLASS] == ELFCLASS64)
+      Ok = readElfBuildId<Elf64_Ehdr, Elf64_Phdr, Elf64_Shdr, Elf64_Nhdr>(
+          Map, Size, BuildId);
+    else if (Map[EI_CLASS] == ELFCLASS32)
+      Ok = readElfBuildId<Elf32_Ehdr, Elf32_Phdr, Elf32_Shdr, Elf32_Nhdr>(
+          Map, Size, BuildId);
+  }
+  munmap(const_cast<char *>(Map), Size);
+  return Ok && !BuildId->empty() && BuildId->size() <= kMaxBuildIdSize;
+}
+
+std::string buildIdToHex(const std::string &BuildId) {
+  static const char kDigits[] = "0123456789abcdef";
+  std::string Hex;
+  for (size_t I = 0; I < BuildId.size(); ++I) {
+    unsigned char C = BuildId[I];
+    Hex += kDigits[C >> 4];
+    Hex += kDigits[C & 15];
+  }
+  return Hex;
+}
+
+SymbolIndex *SymbolIndex::open(const char *Path, const std::string &BuildId) {
+  size_t Size;
+  const char *Map = mapFile(Path, &Size);
+  if (!Map)
+    return 0;
+  const SymbolIndexHeader *H =
+      reinterpret_cast<const SymbolIndexHeader *>(Map);
+  // Every table must fit in the file, and the last range must be a hole so
+  // that no range runs to the end of the address space.
+  bool Ok =
+      Size >= sizeof(*H) && memcmp(H->Magic, kMagic, sizeof(kMagic)) == 0 &&
+      H->Version == kVersion && H->BuildIdSize == BuildId.size() &&
+      memcmp(H->BuildId, BuildId.data(), BuildId.size()) == 0 &&
+      H->NumRanges <= Size / sizeof(SymbolIndexRange) &&
+      H->RangesOffset <= Size - H->NumRanges * sizeof(SymbolIndexRange) &&
+      H->NumChainEntries <= Size / sizeof(uint32_t) &&
+      H->ChainsOffset <= Size - H->NumChainEntries * sizeof(uint32_t) &&
+      H->NumFrames <= Size / sizeof(SymbolIndexFrame) &&
+      H->FramesOffset <= Size - H->NumFrames * sizeof(SymbolIndexFrame) &&
+      H->StringsSize > 0 && H->StringsSize <= Size &&
+      H->StringsOffset <= Size - H->StringsSize &&
+      Map[H->StringsOffset + H->StringsSize - 1] == '\0' &&
+      H->RangesOffset % sizeof(uint64_t) == 0 &&
+      H->ChainsOffset % sizeof(uint32_t) == 0 &&
+      H->FramesOffset % sizeof(uint32_t) == 0;
+  if (Ok && H->NumRanges > 0) {
+    const SymbolIndexRange *Last = reinterpret_cast<const SymbolIndexRange *>(
+        Map + H->RangesOffset) + H->NumRanges - 1;
+    Ok = Last->NumFrames == 0;
+  }
+  if (!Ok) {
+    munmap(const_cast<char *>(Map), Size);
+    return 0;
+  }
+  SymbolIndex *Index = new SymbolIndex;
+  Index->Header = H;
+  Index->Ranges =
+      reinterpret_cast<const SymbolIndexRange *>(Map + H->RangesOffset);
+  Index->Chains = reinterpret_cast<const uint32_t *>(Map + H->ChainsOffset);
+  Index->Frames =
+      reinterpret_cast<const SymbolIndexFrame *>(Map + H->FramesOffset);
+  Index->Strings = Map + H->StringsOffset;
+  return Index;
+}
+
+bool SymbolIndex::symbolizeCode(uint64_t Offset, std::string *Result) const {
+  // The last range starting at or before Offset.
+  uint64_t Lo = 0, Hi = Header->NumRanges;
+  while (Lo < Hi) {
+    uint64_t Mid = Lo + (Hi - Lo) / 2;
+    if (Ranges[Mid].Start <= Offset)
+      Lo = Mid + 1;
+    else
+      Hi = Mid;
+  }
+  if (Lo == 0)
+    return false;
+  const SymbolIndexRange &Range = Ranges[Lo - 1];
+  if (Range.NumFrames == 0 || Range.NumFrames > Header->NumChainEntries ||
+      Range.Chain > Header->NumChainEntries - Range.NumFrames)
+    return false;
+  Result->clear();
+  for (uint32_t I = 0; I < Range.NumFrames; ++I) {
+    uint32_t F = Chains[Range.Chain + I];
+    if (F >= Header->NumFrames)
+      return false;
+    const SymbolIndexFrame &Frame = Frames[F];
+    if (Frame.Function >= Header->StringsSize ||
+        Frame.File >= Header->StringsSize)
+      return false;
+    char LineColumn[32];
+    snprintf(LineColumn, sizeof(LineColumn), ":%u:%u\n", Frame.Line,
+             Frame.Column);
+    *Result += Strings + Frame.Function;
+    *Result += '\n';
+    *Result += Strings + Frame.File;
+    *Result += LineColumn;
+  }
+  return true;
+}
+
+const SymbolIndex *findSymbolIndex(const char *ModulePath) {
+  static std::map<std::string, SymbolIndex *> *Indices =
+      new std::map<std::string, SymbolIndex *>;
+  std::map<std::string, SymbolIndex *>::iterator I = Indices->find(ModulePath);
+  if (I != Indices->end())
+    return I->second;
+  SymbolIndex *Index = 0;
+  const char *Dirs = getenv(kIndexPathEnv);
+  std::string BuildId;
+  if (Dirs && *Dirs && readBuildId(ModulePath, &BuildId)) {
+    std::string Name = "/" + buildIdToHex(BuildId) + kIndexSuffix;
+    while (!Index) {
+      const char *End = strchr(Dirs, ':');
+      std::string Dir = End ? std::string(Dirs, End) : std::string(Dirs);
+      if (!Dir.empty())
+        Index = SymbolIndex::open((Dir + Name).c_str(), BuildId);
+      if (!End)
+        break;
+      Dirs = End + 1;
+    }
+  }
+  (*Indices)[ModulePath] = Index;
+  return Index;
+}
+
+}  // namespace symbol_index
@@ -0,0 +1,97 @@
+// Compact, mmap-able symbol index of one ELF module, keyed by its build ID.
+//
+// Symbolizing from DWARF means parsing the debug info of every module on the
+// stack in every fresh process. An index, written once per build by
+// symbol_index_gen, maps address ranges straight to their inline chains:
+//
+//   SymbolIndexHeader
+//   SymbolIndexRange  Ranges[NumRanges]    sorted by Start; a range ends where
+//                                          the next one starts, and one with
+//                                          no frames is a hole
+//   uint32_t          Chains[NumChainEntries]
+//                                          indices into Frames, a range's
+//                                          inline chain is NumFrames of them
+//                                          from Chain, innermost first
+//   SymbolIndexFrame  Frames[NumFrames]
+//   char              Strings[StringsSize] NUL-terminated names, deduplicated
+//
+// Offsets are from the start of the file, numbers are in host byte order.
+// __llvm_symbolize_code looks for <build ID in hex>.symidx in the directories
+// of SANITIZER_SYMBOL_INDEX_PATH (colon-separated) and falls back to DWARF for
+// modules without an index and addresses it doesn't cover.
+
+#ifndef SYMBOL_INDEX_H
+#define SYMBOL_INDEX_H
+
+#include <stdint.h>
+#include <string>
+
+namespace symbol_index {
+
+const char kMagic[8] = { 'S', 'Y', 'M', 'I', 'D', 'X', '\0', '\0' };
+const uint32_t kVersion = 1;
+const uint32_t kMaxBuildIdSize = 64;
+const char kIndexPathEnv[] = "SANITIZER_SYMBOL_INDEX_PATH";
+const char kIndexSuffix[] = ".symidx";
+
+struct SymbolIndexHeader {
+  char Magic[8];
+  uint32_t Version;
+  uint32_t BuildIdSize;
+  uint8_t BuildId[kMaxBuildIdSize];
+  uint64_t NumRanges;
+  uint64_t RangesOffset;
+  uint64_t NumChainEntries;
+  uint64_t ChainsOffset;
+  uint64_t NumFrames;
+  uint64_t FramesOffset;
+  uint64_t StringsSize;
+  uint64_t StringsOffset;
+};
+
+struct SymbolIndexRange {
+  uint64_t Start;
+  uint32_t Chain;
+  uint32_t NumFrames;
+};
+
+// Function and File are offsets into Strings.
+struct SymbolIndexFrame {
+  uint32_t Function;
+  uint32_t File;
+  uint32_t Line;
+  uint32_t Column;
+};
+
+// The raw NT_GNU_BUILD_ID of the ELF file at Path.
+bool readBuildId(const char *Path, std::string *BuildId);
+
+std::string buildIdToHex(const std::string &BuildId);
+
+class SymbolIndex {
+ public:
+  // Maps the index at Path if it is well-formed and made for BuildId.
+  static SymbolIndex *open(const char *Path, const std::string &BuildId);
+
+  // Writes the inline chain at Offset the way LLVMSymbolizer::symbolizeCode
+  // does, "function\nfile:line:column\n" per frame. False if the index
+  // doesn't cover Offset.
+  bool symbolizeCode(uint64_t Offset, std::string *Result) const;
+
+ private:
+  SymbolIndex() {}
+
+  const SymbolIndexHeader *Header;
+  const SymbolIndexRange *Ranges;
+  const uint32_t *Chains;
+  const SymbolIndexFrame *Frames;
+  const char *Strings;
+};
+
+// The index of the module at ModulePath, looked up once per module in the
+// directories of SANITIZER_SYMBOL_INDEX_PATH. 0 if there is none.
+const SymbolIndex *findSymbolIndex(const char *ModulePath);
+
+}  // namespace symbol_index
+
+#endif  // SYMBOL_INDEX_H
@@ -109,7 +109,8 @@ for BITS in 32 64; do
   LLVM_CFLAGS="-I${LLVM_CHECKOUT}/include -I${LLVM_BUILD}/include -D__STDC_LIMIT_MACROS -D__STDC_CONSTANT_MACROS"
   ${CLANG}++ -v ${CFLAGS} ${LLVM_CFLAGS} ${ROOT}/SanitizerLibcWrapper.cpp -c -o SanitizerLibcWrapper.o
   ${CLANG}++ -v ${CFLAGS} ${LLVM_CFLAGS} LLVMSymbolize.cpp -c -o LLVMSymbolize.o
-  ${CLANG}++ -v ${CFLAGS} ${LLVM_CFLAGS} LLVMSymbolizeInterface.cpp -c -o LLVMSymbolizeInterface.o
+  ${CLANG}++ -v ${CFLAGS} ${LLVM_CFLAGS} -I${ROOT} LLVMSymbolizeInterface.cpp -c -o LLVMSymbolizeInterface.o
+  ${CLANG}++ -v ${CFLAGS} ${ROOT}/SymbolIndex.cpp -c -o SymbolIndex.o
 
   # Merge LLVMSymbolize object files and other static LLVM libraries into a single object.
   for f in *.a; do
@@ -122,7 +123,7 @@ for BITS in 32 64; do
   done
   rm -f *.a
 
-  SYMBOLIZER_API_LIST=__llvm_symbolize_set_demangling,__llvm_symbolize_code,__llvm_symbolize_data,__llvm_symbolize_flush,__llvm_symbolize_demangle
+  SYMBOLIZER_API_LIST=__llvm_symbolize_set_demangling,__llvm_symbolize_code,__llvm_symbolize_code_batch,__llvm_symbolize_data,__llvm_symbolize_flush,__llvm_symbolize_demangle,__llvm_symbolize_warm_up
 
   # Merge all the object files together and copy the resulting library back.
   INTERNAL_SYMBOLIZER_LIBNAME=sanitizer_internal_symbolizer${BITS}.a
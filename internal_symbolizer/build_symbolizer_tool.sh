@@ -0,0 +1,41 @@
+#!/bin/bash -exu
+
+# Script to build one of the standalone tools on top of the LLVMSymbolize C
+# interface, named after its source:
+#   ./build_symbolizer_tool.sh kasan_symbolizer.cpp    -> kasan_symbolizer
+#   ./build_symbolizer_tool.sh symbolizer_server.cpp   -> symbolizer_server
+#   ./build_symbolizer_tool.sh symbol_index_gen.cpp    -> symbol_index_gen
+# Unlike the internal symbolizer archive they use the system libc and the
+# regular LLVM libraries, so any LLVM build tree will do. OUTPUT overrides
+# the path of the binary.
+
+ROOT="$(cd "$(dirname "$0")" && pwd)"
+TOOL_SOURCE=${1:-}
+if [[ "$TOOL_SOURCE" == "" || ! -f "${ROOT}/$(basename "$TOOL_SOURCE")" ]]; then
+  echo "Usage: $0 <tool source in ${ROOT}>"
+  exit 1
+fi
+TOOL_SOURCE=$(basename "$TOOL_SOURCE")
+if [[ "$LLVM_CHECKOUT" == "" ||
+      ! -f "${LLVM_CHECKOUT}/tools/llvm-symbolizer/LLVMSymbolize.cpp" ]]; then
+  echo "Missing or incomplete LLVM_CHECKOUT"
+  exit 1
+fi
+if [[ "$LLVM_BUILD" == "" ||
+      ! -f "${LLVM_BUILD}/lib/libLLVMDebugInfo.a" ]]; then
+  echo "Missing or incomplete LLVM_BUILD"
+  exit 1
+fi
+
+CXX=${CXX:-clang++}
+OUTPUT=${OUTPUT:-$(pwd)/${TOOL_SOURCE%.cpp}}
+
+LLVM_CFLAGS="-I${LLVM_CHECKOUT}/include -I${LLVM_BUILD}/include -I${LLVM_CHECKOUT}/tools/llvm-symbolizer -D__STDC_LIMIT_MACROS -D__STDC_CONSTANT_MACROS"
+${CXX} -O2 -fno-rtti ${LLVM_CFLAGS} \
+  ${ROOT}/${TOOL_SOURCE} \
+  ${ROOT}/LLVMSymbolizeInterface.cpp ${ROOT}/SymbolIndex.cpp \
+  ${LLVM_CHECKOUT}/tools/llvm-symbolizer/LLVMSymbolize.cpp \
+  -L${LLVM_BUILD}/lib -lLLVMDebugInfo -lLLVMObject -lLLVMSupport \
+  -lz -lpthread -ldl -o ${OUTPUT}
+
+echo ${OUTPUT}
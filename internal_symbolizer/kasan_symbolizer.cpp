@@ -0,0 +1,356 @@
+// Standalone KASAN report symbolizer on top of the __llvm_symbolize_code C
+// interface (see LLVMSymbolizeInterface.cpp).
+//
+// Does what tools/kasan_symbolize.py does, without a round trip to addr2line
+// per frame and without parsing nm output: function+offset pairs are resolved
+// against the ELF symbol table, read in-process and sorted by name, and the
+// resulting module offsets are symbolized in-process.
+//
+// Usage: kasan_symbolizer <linux path> [<strip path>] < log > symbolized_log
+
+#include <ctype.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+extern "C" bool __llvm_symbolize_code(const char *ModuleName,
+                                      uint64_t ModuleOffset, char *Buffer,
+                                      int MaxLength);
+
+namespace {
+
+typedef std::pair<std::string, uint64_t> Symbol;
+
+struct SymbolNameLess {
+  bool operator()(const Symbol &A, const Symbol &B) const {
+    return A.first < B.first;
+  }
+};
+
+// Function name -> address table of one module, sorted for binary search.
+class SymbolTable {
+ public:
+  bool load(const char *Path) {
+    int Fd = open(Path, O_RDONLY);
+    if (Fd < 0)
+      return false;
+    struct stat St;
+    if (fstat(Fd, &St) != 0 || St.st_size < EI_NIDENT) {
+      close(Fd);
+      return false;
+    }
+    void *Map = mmap(0, St.st_size, PROT_READ, MAP_PRIVATE, Fd, 0);
+    close(Fd);
+    if (Map == MAP_FAILED)
+      return false;
+    const unsigned char *Ident = static_cast<const unsigned char *>(Map);
+    bool Ok = false;
+    if (memcmp(Ident, ELFMAG, SELFMAG) == 0) {
+      if (Ident[EI_CLASS] == ELFCLASS64)
+        Ok = loadElf<Elf64_Ehdr, Elf64_Shdr, Elf64_Sym>(Map, St.st_size);
+      else if (Ident[EI_CLASS] == ELFCLASS32)
+        Ok = loadElf<Elf32_Ehdr, Elf32_Shdr, Elf32_Sym>(Map, St.st_size);
+    }
+    munmap(Map, St.st_size);
+    // Stable, so that the last of several equally named symbols wins, as it
+    // did with the nm dictionary of kasan_symbolize.py.
+    std::stable_sort(Symbols.begin(), Symbols.end(), SymbolNameLess());
+    return Ok;
+  }
+
+  bool lookup(const std::string &Name, uint64_t *Addr) const {
+    std::vector<Symbol>::const_iterator It =
+        std::upper_bound(Symbols.begin(), Symbols.end(),
+                         Symbol(Name, 0), SymbolNameLess());
+    if (It == Symbols.begin() || (It - 1)->first != Name)
+      return false;
+    *Addr = (It - 1)->second;
+    return true;
+  }
+
+ private:
+  template <class Ehdr, class Shdr, class Sym>
+  bool loadElf(const void *Map, size_t Size) {
+    const char *Base = static_cast<const char *>(Map);
+    const Ehdr *Header = reinterpret_cast<const Ehdr *>(Base);
+    if (Size < sizeof(Ehdr) ||
+        Header->e_shoff + Header->e_shnum * sizeof(Shdr) > Size)
+      return false;
+    const Shdr *Sections =
+        reinterpret_cast<const Shdr *>(Base + Header->e_shoff);
+    for (unsigned I = 0; I < Header->e_shnum; ++I) {
+      if (Sections[I].sh_type != SHT_SYMTAB ||
+          Sections[I].sh_link >= Header->e_shnum)
+        continue;
+      const Shdr &Strtab = Sections[Sections[I].sh_link];
+      if (Sections[I].sh_offset + Sections[I].sh_size > Size ||
+          Strtab.sh_offset + Strtab.sh_size > Size)
+        return false;
+      const Sym *Syms =
+          reinterpret_cast<const Sym *>(Base + Sections[I].sh_offset);
+      size_t NumSyms = Sections[I].sh_size / sizeof(Sym);
+      const char *Names = Base + Strtab.sh_offset;
+      Symbols.reserve(Symbols.size() + NumSyms);
+      for (size_t J = 0; J < NumSyms; ++J) {
+        if (Syms[J].st_shndx == SHN_UNDEF || Syms[J].st_name == 0 ||
+            Syms[J].st_name >= Strtab.sh_size)
+          continue;
+        const char *Name = Names + Syms[J].st_name;
+        if (!memchr(Name, 0, Strtab.sh_size - Syms[J].st_name))
+          continue;
+        Symbols.push_back(Symbol(Name, Syms[J].st_value));
+      }
+    }
+    return true;
+  }
+
+  std::vector<Symbol> Symbols;
+};
+
+struct Frame {
+  std::string Function;
+  std::string FileLine;
+};
+
+// One line of the log, split like frame_re in kasan_symbolize.py:
+//  [<addr>] (? )?function+0xoffset/0xsize( [module])?
+struct FrameLine {
+  std::string Addr;
+  std::string Suffix;
+  std::string Function;
+  uint64_t Offset;
+  std::string Module;
+};
+
+bool isHex(char C) { return isxdigit(static_cast<unsigned char>(C)); }
+
+bool parseHex(const std::string &S, size_t *Pos, uint64_t *Value) {
+  if (S.compare(*Pos, 2, "0x") != 0)
+    return false;
+  size_t End = *Pos + 2;
+  while (End < S.size() && isHex(S[End]))
+    ++End;
+  if (End == *Pos + 2)
+    return false;
+  *Value = strtoull(S.c_str() + *Pos + 2, 0, 16);
+  *Pos = End;
+  return true;
+}
+
+bool parseFrameLine(const std::string &Line, FrameLine *F) {
+  if (Line.compare(0, 3, " [<") != 0)
+    return false;
+  size_t AddrEnd = 3;
+  while (AddrEnd < Line.size() && isHex(Line[AddrEnd]))
+    ++AddrEnd;
+  if (AddrEnd == 3 || Line.compare(AddrEnd, 3, ">] ") != 0)
+    return false;
+  F->Addr = Line.substr(3, AddrEnd - 3);
+  size_t Start = AddrEnd + 3;
+  if (Line.compare(Start, 2, "? ") == 0)
+    Start += 2;
+  size_t Plus = Line.find('+', Start);
+  if (Plus == std::string::npos || Plus == Start)
+    return false;
+  F->Function = Line.substr(Start, Plus - Start);
+  size_t Pos = Plus + 1;
+  uint64_t Size;
+  if (!parseHex(Line, &Pos, &F->Offset) || Line.compare(Pos, 1, "/") != 0)
+    return false;
+  ++Pos;
+  if (!parseHex(Line, &Pos, &Size))
+    return false;
+  F->Module.clear();
+  if (Pos != Line.size()) {
+    if (Line.compare(Pos, 2, " [") != 0 || Line[Line.size() - 1] != ']' ||
+        Line.size() - Pos < 4)
+      return false;
+    F->Module = Line.substr(Pos + 2, Line.size() - Pos - 3);
+  }
+  F->Suffix = Line.substr(Start);
+  return true;
+}
+
+// Drops a leading "[   12.345678] " kernel timestamp.
+std::string stripTime(const std::string &Line) {
+  if (Line.empty() || Line[0] != '[')
+    return Line;
+  size_t Pos = 1;
+  while (Pos < Line.size() && Line[Pos] == ' ')
+    ++Pos;
+  size_t Digits = Pos;
+  while (Pos < Line.size() && (isdigit(Line[Pos]) || Line[Pos] == '.'))
+    ++Pos;
+  if (Pos == Digits || Pos == Line.size() || Line[Pos] != ']')
+    return Line;
+  ++Pos;
+  if (Pos < Line.size() && Line[Pos] == ' ')
+    ++Pos;
+  return Line.substr(Pos);
+}
+
+// vmlinux and *.ko files under the kernel tree, first match wins.
+std::map<std::string, std::string> *ModulePaths;
+
+int indexModule(const char *Path, const struct stat *, int Type,
+                struct FTW *Ftw) {
+  if (Type != FTW_F)
+    return 0;
+  const char *Name = Path + Ftw->base;
+  size_t Len = strlen(Name);
+  if (strcmp(Name, "vmlinux") == 0 ||
+      (Len > 3 && strcmp(Name + Len - 3, ".ko") == 0))
+    ModulePaths->insert(std::make_pair(std::string(Name), std::string(Path)));
+  return 0;
+}
+
+class ReportProcessor {
+ public:
+  ReportProcessor(const char *LinuxPath, const char *StripPath)
+      : StripPath(StripPath ? StripPath : "") {
+    ModulePaths = &Paths;
+    nftw(LinuxPath, indexModule, 64, FTW_PHYS);
+  }
+
+  ~ReportProcessor() {
+    for (std::map<std::string, SymbolTable *>::iterator I = Tables.begin();
+         I != Tables.end(); ++I)
+      delete I->second;
+  }
+
+  void processLine(const std::string &RawLine) {
+    std::string Line = stripTime(RawLine);
+    FrameLine F;
+    std::vector<Frame> Frames;
+    if (!parseFrameLine(Line, &F) || !symbolize(F, &Frames) ||
+        Frames.empty()) {
+      printf("%s\n", Line.c_str());
+      return;
+    }
+    for (size_t I = 0; I + 1 < Frames.size(); ++I)
+      printf(" [<     inlined    >] %s %s %s\n", F.Suffix.c_str(),
+             Frames[I].Function.c_str(), stripPath(Frames[I].FileLine).c_str());
+    printf(" [<%s>] %s %s\n", F.Addr.c_str(), F.Suffix.c_str(),
+           stripPath(Frames.back().FileLine).c_str());
+  }
+
+ private:
+  bool symbolize(const FrameLine &F, std::vector<Frame> *Frames) {
+    std::string Module = F.Module.empty() ? "vmlinux" : F.Module + ".ko";
+    std::map<std::string, std::string>::const_iterator Path =
+        Paths.find(Module);
+    if (Path == Paths.end())
+      return false;
+    SymbolTable *Table = getTable(Module, Path->second);
+    uint64_t SymbolAddr;
+    if (!Table || !Table->lookup(F.Function, &SymbolAddr))
+      return false;
+    // The return address points after the call, step back into it.
+    uint64_t ModuleOffset = SymbolAddr + F.Offset - 1;
+
+    std::pair<std::string, uint64_t> Key(Module, ModuleOffset);
+    std::map<std::pair<std::string, uint64_t>, std::vector<Frame> >::iterator
+        Cached = Results.find(Key);
+    if (Cached != Results.end()) {
+      *Frames = Cached->second;
+      return true;
+    }
+    char Buffer[16384];
+    if (!__llvm_symbolize_code(Path->second.c_str(), ModuleOffset, Buffer,
+                               sizeof(Buffer)))
+      return false;
+    parseSymbolizerOutput(Buffer, Frames);
+    Results[Key] = *Frames;
+    return true;
+  }
+
+  SymbolTable *getTable(const std::string &Module, const std::string &Path) {
+    std::map<std::string, SymbolTable *>::iterator I = Tables.find(Module);
+    if (I != Tables.end())
+      return I->second;
+    SymbolTable *Table = new SymbolTable;
+    if (!Table->load(Path.c_str())) {
+      delete Table;
+      Table = 0;
+    }
+    Tables[Module] = Table;
+    return Table;
+  }
+
+  // The symbolizer prints a "function\nfile:line:column\n" pair per frame,
+  // innermost inlined frame first. Unknown functions are dropped and the
+  // column is cut off, to match addr2line.
+  static void parseSymbolizerOutput(const char *Buffer,
+                                    std::vector<Frame> *Frames) {
+    Frames->clear();
+    const char *P = Buffer;
+    while (*P) {
+      const char *FuncEnd = strchr(P, '\n');
+      if (!FuncEnd)
+        break;
+      const char *FileEnd = strchr(FuncEnd + 1, '\n');
+      if (!FileEnd)
+        FileEnd = FuncEnd + 1 + strlen(FuncEnd + 1);
+      Frame F;
+      F.Function.assign(P, FuncEnd);
+      F.FileLine.assign(FuncEnd + 1, FileEnd);
+      size_t LastColon = F.FileLine.rfind(':');
+      if (LastColon != std::string::npos &&
+          F.FileLine.find(':') != LastColon)
+        F.FileLine.erase(LastColon);
+      if (F.Function != "??")
+        Frames->push_back(F);
+      P = *FileEnd ? FileEnd + 1 : FileEnd;
+    }
+  }
+
+  std::string stripPath(const std::string &FileLine) const {
+    if (StripPath.empty())
+      return FileLine;
+    size_t Pos = FileLine.find(StripPath);
+    if (Pos == std::string::npos)
+      return FileLine;
+    Pos += StripPath.size();
+    while (Pos < FileLine.size() && FileLine[Pos] == '/')
+      ++Pos;
+    return FileLine.substr(Pos);
+  }
+
+  std::string StripPath;
+  std::map<std::string, std::string> Paths;
+  std::map<std::string, SymbolTable *> Tables;
+  std::map<std::pair<std::string, uint64_t>, std::vector<Frame> > Results;
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 2 && argc != 3) {
+    fprintf(stderr, "Usage: %s <linux path> [<strip path>]\n", argv[0]);
+    return 1;
+  }
+  ReportProcessor Processor(argv[1], argc == 3 ? argv[2] : 0);
+  char *Line = 0;
+  size_t Capacity = 0;
+  ssize_t Len;
+  while ((Len = getline(&Line, &Capacity, stdin)) != -1) {
+    while (Len > 0 && isspace(static_cast<unsigned char>(Line[Len - 1])))
+      --Len;
+    Processor.processLine(std::string(Line, Len));
+  }
+  free(Line);
+  return 0;
+}
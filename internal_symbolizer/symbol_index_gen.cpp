@@ -0,0 +1,425 @@
+// Generator of symbol indices (see SymbolIndex.h) on top of the
+// __llvm_symbolize_code C interface.
+//
+// Every row of the module's line table starts an address range, and every
+// end of a sequence a hole. Each range is symbolized once, in-process, and
+// ranges with the same inline chain are merged. Inlined calls start a new
+// line table row, so a chain doesn't change inside a row.
+//
+// Usage: symbol_index_gen <module> <output dir> [<debug file>]
+// writes <output dir>/<build ID>.symidx. The line table is read from <debug
+// file> if given (for stripped modules), from <module> otherwise.
+
+#include "SymbolIndex.h"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef SHF_COMPRESSED
+#define SHF_COMPRESSED (1 << 11)
+#endif
+
+extern "C" bool __llvm_symbolize_code(const char *ModuleName,
+                                      uint64_t ModuleOffset, char *Buffer,
+                                      int MaxLength);
+
+using namespace symbol_index;
+
+namespace {
+
+typedef std::pair<uint64_t, uint64_t> AddressRange;
+
+// The line program opcodes we need.
+enum {
+  DW_LNS_copy = 1,
+  DW_LNS_advance_pc = 2,
+  DW_LNS_advance_line = 3,
+  DW_LNS_const_add_pc = 8,
+  DW_LNS_fixed_advance_pc = 9,
+  DW_LNE_end_sequence = 1,
+  DW_LNE_set_address = 2,
+};
+
+// The .debug_line section and the code ranges of an ELF file. A separate
+// debug file keeps the addresses of the module's sections.
+struct ElfDebugLine {
+  const char *Data;
+  size_t Size;
+  std::vector<AddressRange> Code;
+};
+
+template <class Ehdr, class Shdr>
+bool findDebugLine(const char *Base, size_t Size, ElfDebugLine *Out) {
+  const Ehdr *Header = reinterpret_cast<const Ehdr *>(Base);
+  if (Size < sizeof(Ehdr) ||
+      Header->e_shoff + Header->e_shnum * sizeof(Shdr) > Size ||
+      Header->e_shstrndx >= Header->e_shnum)
+    return false;
+  const Shdr *Sections =
+      reinterpret_cast<const Shdr *>(Base + Header->e_shoff);
+  const Shdr &Names = Sections[Header->e_shstrndx];
+  if (Names.sh_offset + Names.sh_size > Size)
+    return false;
+  Out->Data = 0;
+  for (unsigned I = 0; I < Header->e_shnum; ++I) {
+    const Shdr &S = Sections[I];
+    if (S.sh_name >= Names.sh_size)
+      continue;
+    const char *Name = Base + Names.sh_offset + S.sh_name;
+    if (S.sh_flags & SHF_EXECINSTR)
+      Out->Code.push_back(AddressRange(S.sh_addr, S.sh_addr + S.sh_size));
+    if (strcmp(Name, ".zdebug_line") == 0 ||
+        (strcmp(Name, ".debug_line") == 0 &&
+         (S.sh_flags & SHF_COMPRESSED))) {
+      fprintf(stderr, "Compressed .debug_line, decompress it first with "
+              "objcopy --decompress-debug-sections\n");
+      return false;
+    }
+    if (strcmp(Name, ".debug_line") == 0 && S.sh_type != SHT_NOBITS &&
+        S.sh_offset + S.sh_size <= Size) {
+      Out->Data = Base + S.sh_offset;
+      Out->Size = S.sh_size;
+    }
+  }
+  return Out->Data != 0;
+}
+
+class Reader {
+ public:
+  Reader(const char *Data, size_t Size) : Data(Data), Size(Size), Pos(0) {}
+
+  bool ok() const { return Pos <= Size; }
+  size_t pos() const { return Pos; }
+  void seek(size_t To) { Pos = To; }
+
+  uint64_t fixed(unsigned Bytes) {
+    uint64_t Value = 0;
+    if (Pos + Bytes > Size) {
+      Pos = Size + 1;
+      return 0;
+    }
+    memcpy(&Value, Data + Pos, Bytes);  // Little-endian hosts only.
+    Pos += Bytes;
+    return Value;
+  }
+
+  uint64_t uleb() {
+    uint64_t Value = 0;
+    for (unsigned Shift = 0; Pos < Size; Shift += 7) {
+      unsigned char Byte = Data[Pos++];
+      if (Shift < 64)
+        Value |= uint64_t(Byte & 0x7f) << Shift;
+      if (!(Byte & 0x80))
+        return Value;
+    }
+    Pos = Size + 1;
+    return 0;
+  }
+
+  void sleb() { uleb(); }
+
+ private:
+  const char *Data;
+  size_t Size;
+  size_t Pos;
+};
+
+bool inCode(const std::vector<AddressRange> &Code, uint64_t Address) {
+  for (size_t I = 0; I < Code.size(); ++I) {
+    if (Address >= Code[I].first && Address < Code[I].second)
+      return true;
+  }
+  return false;
+}
+
+// Runs the line programs of DWARF 2 to 5 for their addresses only. A true
+// boundary starts a row, a false one ends a sequence. Sequences outside the
+// code, like those of functions the linker dropped, are left out.
+bool readLineTable(const ElfDebugLine &Line,
+                   std::map<uint64_t, bool> *Boundaries) {
+  Reader R(Line.Data, Line.Size);
+  while (R.pos() < Line.Size) {
+    uint64_t UnitLength = R.fixed(4);
+    unsigned OffsetSize = 4;
+    if (UnitLength == 0xffffffff) {
+      UnitLength = R.fixed(8);
+      OffsetSize = 8;
+    }
+    size_t UnitEnd = R.pos() + UnitLength;
+    unsigned Version = R.fixed(2);
+    if (!R.ok() || UnitEnd > Line.Size || Version < 2 || Version > 5)
+      return false;
+    if (Version >= 5)
+      R.fixed(2);  // address_size, segment_selector_size
+    uint64_t HeaderLength = R.fixed(OffsetSize);
+    size_t ProgramStart = R.pos() + HeaderLength;
+    unsigned MinInstLength = R.fixed(1);
+    if (Version >= 4)
+      R.fixed(1);  // maximum_operations_per_instruction
+    R.fixed(1);    // default_is_stmt
+    R.fixed(1);    // line_base
+    unsigned LineRange = R.fixed(1);
+    unsigned OpcodeBase = R.fixed(1);
+    std::vector<unsigned> OpcodeLengths(OpcodeBase);
+    for (unsigned I = 1; I < OpcodeBase; ++I)
+      OpcodeLengths[I] = R.fixed(1);
+    if (!R.ok() || LineRange == 0 || OpcodeBase == 0 ||
+        ProgramStart > UnitEnd)
+      return false;
+
+    R.seek(ProgramStart);
+    uint64_t Address = 0;
+    std::vector<uint64_t> Rows;
+    while (R.pos() < UnitEnd) {
+      unsigned Opcode = R.fixed(1);
+      if (Opcode >= OpcodeBase) {
+        Address += (Opcode - OpcodeBase) / LineRange * MinInstLength;
+        Rows.push_back(Address);
+        continue;
+      }
+      switch (Opcode) {
+      case 0: {  // Extended.
+        uint64_t Length = R.uleb();
+        size_t End = R.pos() + Length;
+        unsigned Sub = Length ? R.fixed(1) : 0;
+        if (Sub == DW_LNE_end_sequence) {
+          if (!Rows.empty() && inCode(Line.Code, Rows[0])) {
+            for (size_t I = 0; I < Rows.size(); ++I)
+              (*Boundaries)[Rows[I]] = true;
+            Boundaries->insert(std::make_pair(Address, false));
+          }
+          Rows.clear();
+          Address = 0;
+        } else if (Sub == DW_LNE_set_address && Length - 1 <= 8) {
+          Address = R.fixed(Length - 1);
+        }
+        R.seek(End);
+        break;
+      }
+      case DW_LNS_copy:
+        Rows.push_back(Address);
+        break;
+      case DW_LNS_advance_pc:
+        Address += R.uleb() * MinInstLength;
+        break;
+      case DW_LNS_advance_line:
+        R.sleb();
+        break;
+      case DW_LNS_const_add_pc:
+        Address += (255 - OpcodeBase) / LineRange * MinInstLength;
+        break;
+      case DW_LNS_fixed_advance_pc:
+        Address += R.fixed(2);
+        break;
+      default:
+        for (unsigned I = 0; I < OpcodeLengths[Opcode]; ++I)
+          R.uleb();
+        break;
+      }
+      if (!R.ok())
+        return false;
+    }
+    R.seek(UnitEnd);
+  }
+  return true;
+}
+
+// Builds the tables of the index, sharing equal strings, frames and chains.
+class IndexBuilder {
+ public:
+  IndexBuilder() { intern(""); }
+
+  // Adds a range from the symbolizer's output for its start, or a hole.
+  void addRange(uint64_t Start, const char *Symbolized) {
+    std::vector<uint32_t> Chain;
+    const char *P = Symbolized;
+    while (*P) {
+      const char *FuncEnd = strchr(P, '\n');
+      if (!FuncEnd)
+        break;
+      const char *FileEnd = strchr(FuncEnd + 1, '\n');
+      if (!FileEnd)
+        FileEnd = FuncEnd + 1 + strlen(FuncEnd + 1);
+      std::string Function(P, FuncEnd), FileLine(FuncEnd + 1, FileEnd);
+      // file:line:column, the file name may have colons of its own.
+      size_t Col = FileLine.rfind(':');
+      size_t Ln = Col == std::string::npos ? Col : FileLine.rfind(':', Col - 1);
+      if (Ln == std::string::npos)
+        break;
+      SymbolIndexFrame F;
+      F.Function = intern(Function);
+      F.File = intern(FileLine.substr(0, Ln));
+      F.Line = strtoul(FileLine.c_str() + Ln + 1, 0, 10);
+      F.Column = strtoul(FileLine.c_str() + Col + 1, 0, 10);
+      if (Function != "??" || F.Line != 0)
+        Chain.push_back(frame(F));
+      P = *FileEnd ? FileEnd + 1 : FileEnd;
+    }
+    SymbolIndexRange Range;
+    Range.Start = Start;
+    Range.NumFrames = Chain.size();
+    Range.Chain = Chain.empty() ? 0 : chain(Chain);
+    if (!Ranges.empty() && Ranges.back().NumFrames == Range.NumFrames &&
+        Ranges.back().Chain == Range.Chain)
+      return;
+    Ranges.push_back(Range);
+  }
+
+  bool write(const char *Path, const std::string &BuildId) {
+    // The line table ends every sequence, so the last range is a hole.
+    if (Ranges.empty())
+      addRange(0, "");
+    SymbolIndexHeader H;
+    memset(&H, 0, sizeof(H));
+    memcpy(H.Magic, kMagic, sizeof(kMagic));
+    H.Version = kVersion;
+    H.BuildIdSize = BuildId.size();
+    memcpy(H.BuildId, BuildId.data(), BuildId.size());
+    H.NumRanges = Ranges.size();
+    H.RangesOffset = sizeof(H);
+    H.NumChainEntries = Chains.size();
+    H.ChainsOffset = H.RangesOffset + H.NumRanges * sizeof(SymbolIndexRange);
+    H.NumFrames = Frames.size();
+    H.FramesOffset = H.ChainsOffset + H.NumChainEntries * sizeof(uint32_t);
+    H.StringsSize = Strings.size();
+    H.StringsOffset = H.FramesOffset + H.NumFrames * sizeof(SymbolIndexFrame);
+
+    FILE *Out = fopen(Path, "wb");
+    if (!Out)
+      return false;
+    bool Ok = fwrite(&H, sizeof(H), 1, Out) == 1 &&
+              writeVector(Out, Ranges) && writeVector(Out, Chains) &&
+              writeVector(Out, Frames) &&
+              fwrite(Strings.data(), 1, Strings.size(), Out) ==
+                  Strings.size();
+    return fclose(Out) == 0 && Ok;
+  }
+
+  size_t numRanges() const { return Ranges.size(); }
+
+ private:
+  template <class T>
+  static bool writeVector(FILE *Out, const std::vector<T> &V) {
+    return V.empty() || fwrite(&V[0], sizeof(T), V.size(), Out) == V.size();
+  }
+
+  uint32_t intern(const std::string &S) {
+    std::map<std::string, uint32_t>::iterator I = StringIds.find(S);
+    if (I != StringIds.end())
+      return I->second;
+    uint32_t Id = Strings.size();
+    Strings.append(S.c_str(), S.size() + 1);
+    StringIds[S] = Id;
+    return Id;
+  }
+
+  uint32_t frame(const SymbolIndexFrame &F) {
+    std::vector<uint32_t> Key(4);
+    Key[0] = F.Function;
+    Key[1] = F.File;
+    Key[2] = F.Line;
+    Key[3] = F.Column;
+    std::map<std::vector<uint32_t>, uint32_t>::iterator I = FrameIds.find(Key);
+    if (I != FrameIds.end())
+      return I->second;
+    uint32_t Id = Frames.size();
+    Frames.push_back(F);
+    FrameIds[Key] = Id;
+    return Id;
+  }
+
+  uint32_t chain(const std::vector<uint32_t> &C) {
+    std::map<std::vector<uint32_t>, uint32_t>::iterator I = ChainIds.find(C);
+    if (I != ChainIds.end())
+      return I->second;
+    uint32_t Id = Chains.size();
+    Chains.insert(Chains.end(), C.begin(), C.end());
+    ChainIds[C] = Id;
+    return Id;
+  }
+
+  std::vector<SymbolIndexRange> Ranges;
+  std::vector<uint32_t> Chains;
+  std::vector<SymbolIndexFrame> Frames;
+  std::string Strings;
+  std::map<std::string, uint32_t> StringIds;
+  std::map<std::vector<uint32_t>, uint32_t> FrameIds;
+  std::map<std::vector<uint32_t>, uint32_t> ChainIds;
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 3 && argc != 4) {
+    fprintf(stderr, "Usage: %s <module> <output dir> [<debug file>]\n",
+            argv[0]);
+    return 1;
+  }
+  const char *Module = argv[1];
+  const char *DebugFile = argc == 4 ? argv[3] : Module;
+  // Symbolize from DWARF, not from an older index or a server.
+  unsetenv(kIndexPathEnv);
+  unsetenv("SANITIZER_SYMBOLIZER_SOCKET");
+
+  std::string BuildId;
+  if (!readBuildId(Module, &BuildId)) {
+    fprintf(stderr, "%s: no build ID\n", Module);
+    return 1;
+  }
+  int Fd = open(DebugFile, O_RDONLY);
+  struct stat St;
+  if (Fd < 0 || fstat(Fd, &St) != 0) {
+    perror(DebugFile);
+    return 1;
+  }
+  void *Map = mmap(0, St.st_size, PROT_READ, MAP_PRIVATE, Fd, 0);
+  close(Fd);
+  if (Map == MAP_FAILED) {
+    perror(DebugFile);
+    return 1;
+  }
+  const char *Base = static_cast<const char *>(Map);
+  ElfDebugLine Line;
+  bool Found = false;
+  if (St.st_size >= EI_NIDENT && memcmp(Base, ELFMAG, SELFMAG) == 0) {
+    if (Base[EI_CLASS] == ELFCLASS64)
+      Found = findDebugLine<Elf64_Ehdr, Elf64_Shdr>(Base, St.st_size, &Line);
+    else if (Base[EI_CLASS] == ELFCLASS32)
+      Found = findDebugLine<Elf32_Ehdr, Elf32_Shdr>(Base, St.st_size, &Line);
+  }
+  std::map<uint64_t, bool> Boundaries;
+  if (!Found || !readLineTable(Line, &Boundaries)) {
+    fprintf(stderr, "%s: no usable .debug_line\n", DebugFile);
+    return 1;
+  }
+
+  IndexBuilder Builder;
+  static char Buffer[1 << 16];
+  for (std::map<uint64_t, bool>::iterator I = Boundaries.begin();
+       I != Boundaries.end(); ++I) {
+    Buffer[0] = '\0';
+    if (I->second)
+      __llvm_symbolize_code(Module, I->first, Buffer, sizeof(Buffer));
+    Builder.addRange(I->first, Buffer);
+  }
+  std::string Path =
+      std::string(argv[2]) + "/" + buildIdToHex(BuildId) + kIndexSuffix;
+  if (!Builder.write(Path.c_str(), BuildId)) {
+    perror(Path.c_str());
+    return 1;
+  }
+  printf("%s: %zu ranges\n", Path.c_str(), Builder.numRanges());
+  return 0;
+}
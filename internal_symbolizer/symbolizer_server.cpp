@@ -0,0 +1,230 @@
+// Symbolization server on top of the __llvm_symbolize_code C interface (see
+// LLVMSymbolizeInterface.cpp).
+//
+// Sanitized processes that find SANITIZER_SYMBOLIZER_SOCKET in their
+// environment send their requests here instead of symbolizing in-process, so
+// libc, libstdc++ and the big binaries of a test farm are parsed once per
+// host rather than once per process. The protocol is one request per line,
+//   CODE <hex offset> <module path>
+//   DATA <hex offset> <module path>
+// with an absolute module path, since the server's working directory isn't
+// the client's, and one reply per request, what the C interface would have written to its
+// buffer followed by a NUL. A client may send several requests before reading
+// the replies, they come back in order.
+//
+// Usage: symbolizer_server <socket path> [<idle seconds>]
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+extern "C" {
+bool __llvm_symbolize_code(const char *ModuleName, uint64_t ModuleOffset,
+                           char *Buffer, int MaxLength);
+bool __llvm_symbolize_data(const char *ModuleName, uint64_t ModuleOffset,
+                           char *Buffer, int MaxLength);
+void __llvm_symbolize_flush();
+}
+
+namespace {
+
+const size_t kMaxLineLength = 8192;
+
+// The symbolizer caches modules by path. A module rebuilt under the same path
+// drops the whole cache, the C interface can't forget just one.
+class ModuleStamps {
+ public:
+  void check(const std::string &Path) {
+    struct stat St;
+    if (stat(Path.c_str(), &St) != 0)
+      return;
+    Stamp New = { St.st_dev, St.st_ino, St.st_size, St.st_mtime };
+    std::map<std::string, Stamp>::iterator I = Stamps.find(Path);
+    if (I == Stamps.end()) {
+      Stamps[Path] = New;
+      return;
+    }
+    const Stamp &Old = I->second;
+    if (Old.Dev == New.Dev && Old.Ino == New.Ino && Old.Size == New.Size &&
+        Old.Mtime == New.Mtime)
+      return;
+    __llvm_symbolize_flush();
+    Stamps.clear();
+    Stamps[Path] = New;
+  }
+
+ private:
+  struct Stamp {
+    dev_t Dev;
+    ino_t Ino;
+    off_t Size;
+    time_t Mtime;
+  };
+  std::map<std::string, Stamp> Stamps;
+};
+
+// Answers one request line, false if it is malformed.
+bool answer(const std::string &Line, ModuleStamps *Stamps,
+            std::string *Reply) {
+  size_t Space = Line.find(' ');
+  if (Space == std::string::npos)
+    return false;
+  std::string Kind = Line.substr(0, Space);
+  if (Kind != "CODE" && Kind != "DATA")
+    return false;
+  char *End;
+  uint64_t Offset = strtoull(Line.c_str() + Space + 1, &End, 16);
+  if (End == Line.c_str() + Space + 1 || *End != ' ' || !End[1])
+    return false;
+  std::string Module(End + 1);
+  if (Module[0] != '/')
+    return false;
+  Stamps->check(Module);
+  static char Buffer[1 << 16];
+  Buffer[0] = '\0';
+  if (Kind == "CODE")
+    __llvm_symbolize_code(Module.c_str(), Offset, Buffer, sizeof(Buffer));
+  else
+    __llvm_symbolize_data(Module.c_str(), Offset, Buffer, sizeof(Buffer));
+  Reply->append(Buffer, strlen(Buffer) + 1);
+  return true;
+}
+
+bool writeAll(int Fd, const std::string &Data) {
+  for (size_t Sent = 0; Sent < Data.size();) {
+    ssize_t N = send(Fd, Data.data() + Sent, Data.size() - Sent, MSG_NOSIGNAL);
+    if (N < 0 && errno == EINTR)
+      continue;
+    if (N <= 0)
+      return false;
+    Sent += N;
+  }
+  return true;
+}
+
+struct Client {
+  int Fd;
+  std::string Input;
+};
+
+// Reads what the client sent and answers its complete lines. False if the
+// client is gone or misbehaves.
+bool serve(Client *C, ModuleStamps *Stamps) {
+  char Chunk[4096];
+  ssize_t N = read(C->Fd, Chunk, sizeof(Chunk));
+  if (N <= 0)
+    return N < 0 && errno == EINTR;
+  C->Input.append(Chunk, N);
+  std::string Reply;
+  size_t Start = 0, Newline;
+  while ((Newline = C->Input.find('\n', Start)) != std::string::npos) {
+    if (!answer(C->Input.substr(Start, Newline - Start), Stamps, &Reply))
+      return false;
+    Start = Newline + 1;
+  }
+  C->Input.erase(0, Start);
+  if (C->Input.size() > kMaxLineLength)
+    return false;
+  return Reply.empty() || writeAll(C->Fd, Reply);
+}
+
+int listenOn(const char *Path) {
+  struct sockaddr_un Addr;
+  if (strlen(Path) >= sizeof(Addr.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", Path);
+    return -1;
+  }
+  memset(&Addr, 0, sizeof(Addr));
+  Addr.sun_family = AF_UNIX;
+  strcpy(Addr.sun_path, Path);
+  int Fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (Fd < 0) {
+    perror("socket");
+    return -1;
+  }
+  // Take over the socket of a dead server, but not of a live one.
+  if (connect(Fd, (struct sockaddr *)&Addr, sizeof(Addr)) == 0) {
+    fprintf(stderr, "A server is already listening on %s\n", Path);
+    close(Fd);
+    return -1;
+  }
+  unlink(Path);
+  // Only the owner may connect: the server reads any file it is asked about.
+  mode_t OldMask = umask(0077);
+  int Res = bind(Fd, (struct sockaddr *)&Addr, sizeof(Addr));
+  umask(OldMask);
+  if (Res != 0 || listen(Fd, 128) != 0) {
+    perror(Path);
+    close(Fd);
+    return -1;
+  }
+  return Fd;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 2 && argc != 3) {
+    fprintf(stderr, "Usage: %s <socket path> [<idle seconds>]\n", argv[0]);
+    return 1;
+  }
+  // We are the server, symbolize in-process.
+  unsetenv("SANITIZER_SYMBOLIZER_SOCKET");
+  int IdleSeconds = argc == 3 ? atoi(argv[2]) : 0;
+  int ListenFd = listenOn(argv[1]);
+  if (ListenFd < 0)
+    return 1;
+  signal(SIGPIPE, SIG_IGN);
+
+  ModuleStamps Stamps;
+  std::vector<Client> Clients;
+  for (;;) {
+    std::vector<struct pollfd> Fds(Clients.size() + 1);
+    Fds[0].fd = ListenFd;
+    Fds[0].events = POLLIN;
+    for (size_t I = 0; I < Clients.size(); ++I) {
+      Fds[I + 1].fd = Clients[I].Fd;
+      Fds[I + 1].events = POLLIN;
+    }
+    int Ready = poll(&Fds[0], Fds.size(),
+                     IdleSeconds > 0 ? IdleSeconds * 1000 : -1);
+    if (Ready < 0 && errno == EINTR)
+      continue;
+    if (Ready < 0) {
+      perror("poll");
+      break;
+    }
+    // Idle: no request for IdleSeconds.
+    if (Ready == 0)
+      break;
+    for (size_t I = Clients.size(); I > 0; --I) {
+      if (!Fds[I].revents)
+        continue;
+      if (!serve(&Clients[I - 1], &Stamps)) {
+        close(Clients[I - 1].Fd);
+        Clients.erase(Clients.begin() + (I - 1));
+      }
+    }
+    if (Fds[0].revents & POLLIN) {
+      int Fd = accept(ListenFd, 0, 0);
+      if (Fd >= 0) {
+        Client C = { Fd, std::string() };
+        Clients.push_back(C);
+      }
+    }
+  }
+  unlink(argv[1]);
+  return 0;
+}
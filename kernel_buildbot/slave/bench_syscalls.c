@@ -0,0 +1,785 @@
+/*
+ * Syscall benchmark harness used to compare KASAN and non-KASAN kernels.
+ *
+ * Each workload is a setup/op/teardown triple run by every thread.  An "op"
+ * is one iteration of the workload's syscall sequence and is timed
+ * individually, so the harness can report latency percentiles as well as
+ * throughput.
+ *
+ * In sweep mode (-s N) every workload is run at 1..N threads and the
+ * scaling efficiency ops(n) / (n * ops(1)) is reported next to the context
+ * switches the threads incurred, which shows where the kernel stops scaling.
+ *
+ * The scatter/gather workloads (readv, preadv, writev, splice) take their
+ * iovec shape from -v/-z/-a/-o.  The defaults reproduce the old bench_readv:
+ * 1024 single-byte iovecs packed into one 1 KB buffer, the worst case for
+ * per-iovec checks.  preadv_cold and -D cover the cold page cache and
+ * O_DIRECT paths that large aligned storage I/O takes.
+ *
+ * Build:
+ *   gcc -O2 -pthread -o bench_syscalls bench_syscalls.c -lrt
+ * Use:
+ *   ./bench_syscalls -w pipe,preadv -t 8 -n 1024 -r 5 -f csv
+ *   ./bench_syscalls -w mmap -s 96 -S 8 -p -P status.log
+ *   ./bench_syscalls -w preadv,splice -v 64 -z 64K -a 4K -o 1M -D
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MMAP_PAGES 4
+
+struct thread_ctx {
+	int id;
+	int fd;
+	int efd;
+	int futex_word;
+	int pipe_fds[2];
+	char *buf;
+	struct iovec *iov;
+	struct iovec *iov_cur;	/* scratch copy consumed by splice_op */
+	uint64_t *lat;		/* nreps * niters per-op latencies, ns */
+	uint64_t *elapsed;	/* nreps per-repetition run times, ns */
+	long vol_csw;		/* context switches during the timed loops */
+	long invol_csw;
+};
+
+struct result {
+	double ops_per_sec;
+	uint64_t median_ns;
+	uint64_t p99_ns;
+	long vol_csw;
+	long invol_csw;
+};
+
+/* prepare, if set, runs untimed before every op. */
+struct workload {
+	const char *name;
+	void (*setup)(struct thread_ctx *ctx);
+	void (*prepare)(struct thread_ctx *ctx);
+	void (*op)(struct thread_ctx *ctx);
+	void (*teardown)(struct thread_ctx *ctx);
+};
+
+static int nthreads = 1;
+static int sweep_max;
+static int sweep_step = 1;
+static long niters = 1024;
+static int nreps = 5;
+static long nwarmup = 64;
+static int pin_threads;
+static int csv_output;
+static const char *data_dir = ".";
+static FILE *status_log;
+
+static int iov_count = 1024;
+static size_t iov_size = 1;
+static size_t iov_align = 1;
+static off_t file_offset;
+static int direct_io;
+
+static char data_path[4096];
+static long page_size;
+static cpu_set_t allowed_cpus;
+static pthread_barrier_t barrier;
+static const struct workload *cur_workload;
+
+static void check(long result, const char *message)
+{
+	if (result < 0) {
+		perror(message);
+		exit(-1);
+	}
+}
+
+static void *xmalloc(size_t size)
+{
+	void *p = malloc(size);
+
+	if (!p) {
+		fprintf(stderr, "Out of memory\n");
+		exit(-1);
+	}
+	return p;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void pin_to_cpu(int id)
+{
+	cpu_set_t set;
+	int n = id % CPU_COUNT(&allowed_cpus);
+	int cpu;
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, &allowed_cpus))
+			continue;
+		if (n-- == 0)
+			break;
+	}
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	errno = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	check(errno ? -1 : 0, "Couldn't pin thread");
+}
+
+/* Accepts an optional K, M or G suffix. */
+static size_t parse_size(const char *arg)
+{
+	char *end;
+	size_t size = strtoul(arg, &end, 0);
+
+	switch (*end) {
+	case 'G':
+		size <<= 10;
+		/* fall through */
+	case 'M':
+		size <<= 10;
+		/* fall through */
+	case 'K':
+		size <<= 10;
+		end++;
+	}
+	return *end ? 0 : size;
+}
+
+static size_t iov_stride(void)
+{
+	return (iov_size + iov_align - 1) / iov_align * iov_align;
+}
+
+/*
+ * Give every iovec its own iov_align-aligned slot and scatter them over the
+ * slots the way the old bench_readv did.
+ */
+static void setup_iov(struct thread_ctx *ctx)
+{
+	size_t stride = iov_stride();
+	size_t align = iov_align > (size_t)page_size ? iov_align
+						      : (size_t)page_size;
+	void *buf;
+	int i;
+
+	errno = posix_memalign(&buf, align, stride * iov_count);
+	check(errno ? -1 : 0, "Couldn't allocate buffer");
+	ctx->buf = buf;
+	memset(ctx->buf, 'a', stride * iov_count);
+	ctx->iov = xmalloc(sizeof(*ctx->iov) * iov_count);
+	ctx->iov_cur = xmalloc(sizeof(*ctx->iov) * iov_count);
+	for (i = 0; i < iov_count; i++) {
+		ctx->iov[i].iov_base = ctx->buf + (i * 31 % iov_count) * stride;
+		ctx->iov[i].iov_len = iov_size;
+	}
+}
+
+static void teardown_iov(struct thread_ctx *ctx)
+{
+	free(ctx->iov_cur);
+	free(ctx->iov);
+	free(ctx->buf);
+}
+
+static void nop_setup(struct thread_ctx *ctx)
+{
+}
+
+static void close_fd_teardown(struct thread_ctx *ctx)
+{
+	check(close(ctx->fd), "close failed");
+}
+
+static void pipe_op(struct thread_ctx *ctx)
+{
+	int fds[2];
+
+	check(pipe(fds), "Couldn't open pipe");
+	close(fds[0]);
+	close(fds[1]);
+}
+
+static void readv_setup(struct thread_ctx *ctx)
+{
+	setup_iov(ctx);
+	ctx->fd = open("/dev/zero", O_RDONLY);
+	check(ctx->fd, "Couldn't open /dev/zero");
+}
+
+static void readv_op(struct thread_ctx *ctx)
+{
+	check(readv(ctx->fd, ctx->iov, iov_count), "Readv failed");
+}
+
+static void readv_teardown(struct thread_ctx *ctx)
+{
+	close_fd_teardown(ctx);
+	teardown_iov(ctx);
+}
+
+static void preadv_setup(struct thread_ctx *ctx)
+{
+	setup_iov(ctx);
+	ctx->fd = open(data_path, O_RDONLY | (direct_io ? O_DIRECT : 0));
+	check(ctx->fd, "Couldn't open file");
+}
+
+/*
+ * Drop the range from the page cache before every read.  Threads share the
+ * data file, so with -t > 1 one thread may refill pages another just evicted.
+ */
+static void preadv_prepare(struct thread_ctx *ctx)
+{
+	errno = posix_fadvise(ctx->fd, file_offset,
+			      (off_t)iov_count * iov_size, POSIX_FADV_DONTNEED);
+	check(errno ? -1 : 0, "fadvise failed");
+}
+
+static void preadv_op(struct thread_ctx *ctx)
+{
+	check(preadv(ctx->fd, ctx->iov, iov_count, file_offset),
+	      "Preadv failed");
+}
+
+/* Every thread writes its own unlinked file so inode locking doesn't skew. */
+static void writev_setup(struct thread_ctx *ctx)
+{
+	char path[4096];
+
+	setup_iov(ctx);
+	snprintf(path, sizeof(path), "%s/bench_syscalls.XXXXXX", data_dir);
+	ctx->fd = mkostemp(path, direct_io ? O_DIRECT : 0);
+	check(ctx->fd, "Couldn't create file");
+	check(unlink(path), "unlink failed");
+}
+
+static void writev_op(struct thread_ctx *ctx)
+{
+	check(pwritev(ctx->fd, ctx->iov, iov_count, file_offset),
+	      "Pwritev failed");
+}
+
+static void splice_setup(struct thread_ctx *ctx)
+{
+	writev_setup(ctx);
+	check(pipe(ctx->pipe_fds), "Couldn't open pipe");
+	/* Fewer round trips through the pipe; the default size still works. */
+	fcntl(ctx->pipe_fds[1], F_SETPIPE_SZ, 1 << 20);
+}
+
+/*
+ * Zero-copy write: vmsplice the user pages into a pipe and splice them on to
+ * the file, as much as the pipe takes at a time.
+ */
+static void splice_op(struct thread_ctx *ctx)
+{
+	struct iovec *iov = ctx->iov_cur;
+	loff_t off = file_offset;
+	int left = iov_count;
+	ssize_t n, out, m;
+
+	memcpy(iov, ctx->iov, sizeof(*iov) * iov_count);
+	while (left) {
+		n = vmsplice(ctx->pipe_fds[1], iov,
+			     left < IOV_MAX ? left : IOV_MAX, SPLICE_F_NONBLOCK);
+		check(n, "vmsplice failed");
+		for (out = n; out; out -= m) {
+			m = splice(ctx->pipe_fds[0], NULL, ctx->fd, &off, out,
+				   SPLICE_F_MOVE);
+			check(m, "splice failed");
+		}
+		while (left && (size_t)n >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			left--;
+		}
+		if (n) {
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+}
+
+static void splice_teardown(struct thread_ctx *ctx)
+{
+	close(ctx->pipe_fds[0]);
+	close(ctx->pipe_fds[1]);
+	readv_teardown(ctx);
+}
+
+static void open_op(struct thread_ctx *ctx)
+{
+	int fd = open(data_path, O_RDONLY);
+
+	check(fd, "Couldn't open file");
+	close(fd);
+}
+
+static void stat_op(struct thread_ctx *ctx)
+{
+	struct stat st;
+
+	check(stat(data_path, &st), "stat failed");
+}
+
+static void mmap_op(struct thread_ctx *ctx)
+{
+	size_t len = MMAP_PAGES * page_size;
+	char *p;
+	int i;
+
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		check(-1, "mmap failed");
+	for (i = 0; i < MMAP_PAGES; i++)
+		p[i * page_size] = 1;
+	check(munmap(p, len), "munmap failed");
+}
+
+/* The futex word never matches, so FUTEX_WAIT returns EAGAIN immediately. */
+static void futex_op(struct thread_ctx *ctx)
+{
+	if (syscall(SYS_futex, &ctx->futex_word, FUTEX_WAIT_PRIVATE, 1,
+		    NULL, NULL, 0) == 0 || errno != EAGAIN)
+		check(-1, "futex wait failed");
+	check(syscall(SYS_futex, &ctx->futex_word, FUTEX_WAKE_PRIVATE, 1,
+		      NULL, NULL, 0), "futex wake failed");
+}
+
+static void epoll_setup(struct thread_ctx *ctx)
+{
+	ctx->efd = eventfd(1, 0);
+	check(ctx->efd, "Couldn't create eventfd");
+}
+
+static void epoll_op(struct thread_ctx *ctx)
+{
+	struct epoll_event ev;
+	int ep = epoll_create1(0);
+
+	check(ep, "Couldn't create epoll");
+	ev.events = EPOLLIN;
+	ev.data.fd = ctx->efd;
+	check(epoll_ctl(ep, EPOLL_CTL_ADD, ctx->efd, &ev), "epoll_ctl failed");
+	check(epoll_wait(ep, &ev, 1, 0), "epoll_wait failed");
+	close(ep);
+}
+
+static void epoll_teardown(struct thread_ctx *ctx)
+{
+	check(close(ctx->efd), "close failed");
+}
+
+static void socketpair_op(struct thread_ctx *ctx)
+{
+	int fds[2];
+	char c = 'a';
+
+	check(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), "socketpair failed");
+	check(write(fds[0], &c, 1), "write failed");
+	check(read(fds[1], &c, 1), "read failed");
+	close(fds[0]);
+	close(fds[1]);
+}
+
+static const struct workload workloads[] = {
+	{ "pipe",	nop_setup,	NULL,	pipe_op,	nop_setup },
+	{ "readv",	readv_setup,	NULL,	readv_op,	readv_teardown },
+	{ "preadv",	preadv_setup,	NULL,	preadv_op,	readv_teardown },
+	{ "preadv_cold", preadv_setup,	preadv_prepare,	preadv_op, readv_teardown },
+	{ "writev",	writev_setup,	NULL,	writev_op,	readv_teardown },
+	{ "splice",	splice_setup,	NULL,	splice_op,	splice_teardown },
+	{ "open",	nop_setup,	NULL,	open_op,	nop_setup },
+	{ "stat",	nop_setup,	NULL,	stat_op,	nop_setup },
+	{ "mmap",	nop_setup,	NULL,	mmap_op,	nop_setup },
+	{ "futex",	nop_setup,	NULL,	futex_op,	nop_setup },
+	{ "epoll",	epoll_setup,	NULL,	epoll_op,	epoll_teardown },
+	{ "socketpair",	nop_setup,	NULL,	socketpair_op,	nop_setup },
+};
+
+#define NWORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+static const struct workload *find_workload(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < NWORKLOADS; i++)
+		if (!strcmp(workloads[i].name, name))
+			return &workloads[i];
+	return NULL;
+}
+
+/* preadv, open and stat share one file sized for the largest read. */
+static void create_data_file(void)
+{
+	size_t len = file_offset + (size_t)iov_count * iov_size;
+	char *buf;
+	int fd;
+
+	snprintf(data_path, sizeof(data_path), "%s/bench_syscalls.XXXXXX",
+		 data_dir);
+	fd = mkstemp(data_path);
+	check(fd, "Couldn't create file");
+	buf = xmalloc(len);
+	memset(buf, 'a', len);
+	if (write(fd, buf, len) != (ssize_t)len)
+		check(-1, "Couldn't fill file");
+	free(buf);
+	/* Written back, so fadvise can really drop it in cold cache mode. */
+	check(fsync(fd), "fsync failed");
+	check(close(fd), "close failed");
+}
+
+static void remove_data_file(void)
+{
+	unlink(data_path);
+}
+
+static void *bench_thread(void *arg)
+{
+	struct thread_ctx *ctx = arg;
+	const struct workload *w = cur_workload;
+	struct rusage before, after;
+	uint64_t start;
+	uint64_t *lat;
+	long i;
+	int rep;
+
+	if (pin_threads)
+		pin_to_cpu(ctx->id);
+	w->setup(ctx);
+	for (i = 0; i < nwarmup; i++)
+		w->op(ctx);
+	for (rep = 0; rep < nreps; rep++) {
+		check(getrusage(RUSAGE_THREAD, &before), "getrusage failed");
+		lat = ctx->lat + rep * niters;
+		pthread_barrier_wait(&barrier);
+		ctx->elapsed[rep] = 0;
+		for (i = 0; i < niters; i++) {
+			if (w->prepare)
+				w->prepare(ctx);
+			start = now_ns();
+			w->op(ctx);
+			lat[i] = now_ns() - start;
+			ctx->elapsed[rep] += lat[i];
+		}
+		check(getrusage(RUSAGE_THREAD, &after), "getrusage failed");
+		ctx->vol_csw += after.ru_nvcsw - before.ru_nvcsw;
+		ctx->invol_csw += after.ru_nivcsw - before.ru_nivcsw;
+	}
+	w->teardown(ctx);
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static uint64_t percentile(const uint64_t *sorted, size_t n, int pct)
+{
+	size_t idx = (n * pct + 99) / 100;
+
+	return sorted[idx ? idx - 1 : 0];
+}
+
+/* Append /proc/self/status once the workload threads have been joined. */
+static void log_proc_status(const struct workload *w, int n)
+{
+	char buf[4096];
+	size_t len;
+	FILE *status;
+
+	if (!status_log)
+		return;
+	status = fopen("/proc/self/status", "r");
+	if (!status)
+		check(-1, "Couldn't open /proc/self/status");
+	fprintf(status_log, "# %s threads=%d\n", w->name, n);
+	while ((len = fread(buf, 1, sizeof(buf), status)) > 0)
+		fwrite(buf, 1, len, status_log);
+	fclose(status);
+	fflush(status_log);
+}
+
+static void run_workload(const struct workload *w, int n, struct result *res)
+{
+	struct thread_ctx *ctxs;
+	pthread_t *threads;
+	uint64_t *all_lat;
+	double *rates;
+	size_t nlat = (size_t)nreps * niters;
+	int i, rep, rc;
+
+	cur_workload = w;
+	ctxs = calloc(n, sizeof(*ctxs));
+	threads = xmalloc(sizeof(*threads) * n);
+	if (!ctxs)
+		check(-1, "calloc failed");
+	pthread_barrier_init(&barrier, NULL, n);
+	for (i = 0; i < n; i++) {
+		ctxs[i].id = i;
+		ctxs[i].lat = xmalloc(sizeof(uint64_t) * nlat);
+		ctxs[i].elapsed = xmalloc(sizeof(uint64_t) * nreps);
+		rc = pthread_create(&threads[i], NULL, bench_thread, &ctxs[i]);
+		if (rc) {
+			printf("Couldn't start thread. error %d\n", rc);
+			exit(-1);
+		}
+	}
+	for (i = 0; i < n; i++) {
+		rc = pthread_join(threads[i], NULL);
+		if (rc) {
+			printf("Couldn't join thread. error %d\n", rc);
+			exit(-1);
+		}
+	}
+	pthread_barrier_destroy(&barrier);
+	log_proc_status(w, n);
+
+	/* A repetition lasts as long as its slowest thread's timed ops. */
+	rates = xmalloc(sizeof(double) * nreps);
+	for (rep = 0; rep < nreps; rep++) {
+		uint64_t slowest = 1;
+
+		for (i = 0; i < n; i++)
+			if (ctxs[i].elapsed[rep] > slowest)
+				slowest = ctxs[i].elapsed[rep];
+		rates[rep] = (double)n * niters * 1e9 / slowest;
+	}
+	qsort(rates, nreps, sizeof(double), cmp_double);
+	res->ops_per_sec = rates[nreps / 2];
+
+	all_lat = xmalloc(sizeof(uint64_t) * nlat * n);
+	res->vol_csw = res->invol_csw = 0;
+	for (i = 0; i < n; i++) {
+		memcpy(all_lat + i * nlat, ctxs[i].lat, sizeof(uint64_t) * nlat);
+		res->vol_csw += ctxs[i].vol_csw;
+		res->invol_csw += ctxs[i].invol_csw;
+	}
+	qsort(all_lat, nlat * n, sizeof(uint64_t), cmp_u64);
+	res->median_ns = percentile(all_lat, nlat * n, 50);
+	res->p99_ns = percentile(all_lat, nlat * n, 99);
+
+	for (i = 0; i < n; i++) {
+		free(ctxs[i].lat);
+		free(ctxs[i].elapsed);
+	}
+	free(all_lat);
+	free(rates);
+	free(threads);
+	free(ctxs);
+}
+
+/* Efficiency is only known in sweep mode; a negative value omits it. */
+static void print_result(const struct workload *w, int n,
+			 const struct result *res, double efficiency)
+{
+	if (csv_output) {
+		printf("%s,%d,%d,%ld,%.0f,%llu,%llu,", w->name, n, nreps,
+		       niters, res->ops_per_sec,
+		       (unsigned long long)res->median_ns,
+		       (unsigned long long)res->p99_ns);
+		if (efficiency >= 0)
+			printf("%.3f", efficiency);
+		printf(",%ld,%ld\n", res->vol_csw, res->invol_csw);
+	} else {
+		printf("%-11s threads=%d ops/s=%.0f median=%lluns p99=%lluns",
+		       w->name, n, res->ops_per_sec,
+		       (unsigned long long)res->median_ns,
+		       (unsigned long long)res->p99_ns);
+		if (efficiency >= 0)
+			printf(" eff=%.3f", efficiency);
+		printf(" csw=%ld/%ld\n", res->vol_csw, res->invol_csw);
+	}
+	fflush(stdout);
+}
+
+static void sweep_workload(const struct workload *w)
+{
+	struct result base, res;
+	int n;
+
+	run_workload(w, 1, &base);
+	print_result(w, 1, &base, 1.0);
+	for (n = sweep_step > 1 ? sweep_step : 2; n <= sweep_max;
+	     n += sweep_step) {
+		run_workload(w, n, &res);
+		print_result(w, n, &res, res.ops_per_sec / (n * base.ops_per_sec));
+	}
+}
+
+static void usage(const char *prog)
+{
+	size_t i;
+
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -w LIST  comma-separated workloads, or \"all\" (default)\n"
+		"  -t N     threads (default %d)\n"
+		"  -n N     timed ops per thread per repetition (default %ld)\n"
+		"  -r N     repetitions (default %d)\n"
+		"  -W N     untimed warm-up ops per thread (default %ld)\n"
+		"  -s N     sweep thread counts from 1 to N instead of using -t\n"
+		"  -S N     thread count increment for -s (default %d)\n"
+		"  -P FILE  append /proc/self/status to FILE after every run\n"
+		"  -p       pin thread i to the i-th allowed CPU\n"
+		"  -d DIR   directory for data files (default %s)\n"
+		"  -v N     iovecs per scatter/gather op (default %d, max %d)\n"
+		"  -z SIZE  bytes per iovec, K/M/G suffixes allowed (default %zu)\n"
+		"  -a SIZE  alignment of every iovec in the buffer (default %zu)\n"
+		"  -o SIZE  file offset for preadv[_cold], writev and splice\n"
+		"  -D       use O_DIRECT; sizes and offset must be block aligned\n"
+		"  -f FMT   output format: text or csv\n"
+		"Workloads:",
+		prog, nthreads, niters, nreps, nwarmup, sweep_step, data_dir,
+		iov_count, IOV_MAX, iov_size, iov_align);
+	for (i = 0; i < NWORKLOADS; i++)
+		fprintf(stderr, " %s", workloads[i].name);
+	fprintf(stderr, "\n");
+	exit(-1);
+}
+
+int main(int argc, char **argv)
+{
+	const struct workload *selected[NWORKLOADS];
+	char *list = "all";
+	char *name;
+	size_t nselected = 0;
+	size_t i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "w:t:n:r:W:s:S:P:pd:v:z:a:o:Df:")) != -1) {
+		switch (opt) {
+		case 'w':
+			list = optarg;
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 'n':
+			niters = atol(optarg);
+			break;
+		case 'r':
+			nreps = atoi(optarg);
+			break;
+		case 'W':
+			nwarmup = atol(optarg);
+			break;
+		case 's':
+			sweep_max = atoi(optarg);
+			break;
+		case 'S':
+			sweep_step = atoi(optarg);
+			break;
+		case 'P':
+			status_log = fopen(optarg, "a");
+			if (!status_log)
+				check(-1, "Couldn't open status log");
+			break;
+		case 'p':
+			pin_threads = 1;
+			break;
+		case 'd':
+			data_dir = optarg;
+			break;
+		case 'v':
+			iov_count = atoi(optarg);
+			break;
+		case 'z':
+			iov_size = parse_size(optarg);
+			break;
+		case 'a':
+			iov_align = parse_size(optarg);
+			break;
+		case 'o':
+			file_offset = parse_size(optarg);
+			break;
+		case 'D':
+			direct_io = 1;
+			break;
+		case 'f':
+			if (!strcmp(optarg, "csv"))
+				csv_output = 1;
+			else if (strcmp(optarg, "text"))
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (nthreads < 1 || niters < 1 || nreps < 1 || nwarmup < 0 ||
+	    sweep_max < 0 || sweep_step < 1 || iov_count < 1 ||
+	    iov_count > IOV_MAX || !iov_size || !iov_align)
+		usage(argv[0]);
+
+	if (!strcmp(list, "all")) {
+		for (i = 0; i < NWORKLOADS; i++)
+			selected[nselected++] = &workloads[i];
+	} else {
+		for (name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+			if (nselected == NWORKLOADS)
+				usage(argv[0]);
+			selected[nselected] = find_workload(name);
+			if (!selected[nselected++]) {
+				fprintf(stderr, "Unknown workload %s\n", name);
+				usage(argv[0]);
+			}
+		}
+	}
+
+	page_size = sysconf(_SC_PAGESIZE);
+	check(sched_getaffinity(0, sizeof(allowed_cpus), &allowed_cpus),
+	      "sched_getaffinity failed");
+	create_data_file();
+	atexit(remove_data_file);
+
+	if (csv_output)
+		printf("workload,threads,reps,iters,ops_per_sec,median_ns,"
+		       "p99_ns,efficiency,vol_csw,invol_csw\n");
+	for (i = 0; i < nselected; i++) {
+		struct result res;
+
+		if (sweep_max) {
+			sweep_workload(selected[i]);
+			continue;
+		}
+		run_workload(selected[i], nthreads, &res);
+		print_result(selected[i], nthreads, &res, -1);
+	}
+	return 0;
+}
@@ -64,17 +64,16 @@ cat vm_log | python ../../../../tools/kernel_test_parse.py --annotate --assert_c
 
 echo @@@BUILD_STEP Benchmarks@@@
 
-scp -i ssh/id_rsa -P 10022 ../../bench_pipes.c root@localhost:~/
-ssh -i ssh/id_rsa -p 10022 root@localhost "gcc -pthread -o bench_pipes bench_pipes.c"
-ssh -i ssh/id_rsa -p 10022 root@localhost "/usr/bin/time -p ./bench_pipes 16 1024 8 " 2> bench1
-echo @@@STEP_TEXT@ALLOC $(grep "sys" bench1) @@@
+scp -i ssh/id_rsa -P 10022 ../../bench_syscalls.c root@localhost:~/
+ssh -i ssh/id_rsa -p 10022 root@localhost "gcc -O2 -pthread -o bench_syscalls bench_syscalls.c -lrt"
+ssh -i ssh/id_rsa -p 10022 root@localhost "./bench_syscalls -t 8 -n 1024 -r 5 -p -f csv" > bench_syscalls.csv
+awk -F, 'NR > 1 { printf "@@@STEP_TEXT@%s %s ops/s p99 %sns@@@\n", $1, $5, $7 }' bench_syscalls.csv
 
-scp -i ssh/id_rsa -P 10022 ../../bench_readv.c root@localhost:~/
-ssh -i ssh/id_rsa -p 10022 root@localhost "gcc -pthread -o bench_readv bench_readv.c"
-ssh -i ssh/id_rsa -p 10022 root@localhost "dd of=temp if=/dev/urandom bs=1K count=1"
-ssh -i ssh/id_rsa -p 10022 root@localhost "/usr/bin/time -p ./bench_readv temp 64000 8" 2> bench2
+ssh -i ssh/id_rsa -p 10022 root@localhost "./bench_syscalls -w pipe,mmap,socketpair -s 4 -n 512 -r 3 -p -f csv" > bench_sweep.csv
+awk -F, '$2 == 4 { printf "@@@STEP_TEXT@%s scaling@4 %s@@@\n", $1, $8 }' bench_sweep.csv
 
-echo @@@STEP_TEXT@ACCESS $(grep "sys" bench2) @@@
+ssh -i ssh/id_rsa -p 10022 root@localhost "./bench_syscalls -w preadv,preadv_cold,writev,splice -v 64 -z 64K -a 4K -o 1M -n 128 -r 3 -f csv" > bench_largeio.csv
+awk -F, 'NR > 1 { printf "@@@STEP_TEXT@%s 64x64K %s ops/s@@@\n", $1, $5 }' bench_largeio.csv
 
 ssh -i ssh/id_rsa -p 10022 root@localhost "time sysbench --test=threads --num-threads=512 --thread-locks=4 --thread-yields=1000  run" | tee bench2
 echo @@@STEP_TEXT@ THREAD $(cat bench2 | grep "avg:")@@@
@@ -1,6 +1,7 @@
 // AddressSanitizer - PIN.
 #include "pin.H"
 #include <stdio.h>
+#include <map>
 
 inline uintptr_t MemToShadow(uintptr_t addr) {
   return (addr >> 3) + 0x0000100000000000ULL;
@@ -33,6 +34,11 @@ static uintptr_t access1_if(uintptr_t addr) {
   uint8_t shadow = *(uint8_t*)MemToShadow(addr);
   return shadow && ((addr & 7U) >= shadow);
 }
+// Same as DrASan's ROUGH_READ: partially addressable granules are fine, only
+// fully poisoned ones (shadow >= 8) are reported.
+static uintptr_t access_rough_if(uintptr_t addr) {
+  return inited && *(uint8_t*)MemToShadow(addr) >= 8;
+}
 
 typedef void (*AsanReportCallback)(ADDRINT);
 #define ACCESS_THEN(type)                                             \
@@ -64,20 +70,77 @@ ACCESS_THEN(store4)
 ACCESS_THEN(store2)
 ACCESS_THEN(store1)
 
-void CallbackForTRACE(TRACE trace, void *v) {
-  RTN rtn = TRACE_Rtn(trace);
-  if (!RTN_Valid(rtn)) return;
-  string rtn_name = RTN_Name(rtn);
-  string img_name = IMG_Name(SEC_Img(RTN_Sec(rtn)));
+// How much of an image gets checked, picked once in CallbackForIMG.
+enum ImagePolicy {
+  POLICY_OFF,
+  POLICY_WRITES_ONLY,
+  POLICY_ROUGH_READS,  // Writes fully, reads with access_rough_if.
+  POLICY_FULL,
+};
+
+KNOB<string> KnobPolicy(KNOB_MODE_APPEND, "pintool", "policy", "",
+    "LEVEL:SUBSTRING, use LEVEL (full, rough, writes or off) for the images "
+    "whose path contains SUBSTRING. Checked in order, before the defaults.");
+KNOB<BOOL> KnobVerbose(KNOB_MODE_WRITEONCE, "pintool", "verbose", "0",
+    "print the policy of every image");
 
+static std::map<UINT32, ImagePolicy> image_policy;
+
+static bool ParsePolicyLevel(const string &level, ImagePolicy *policy) {
+  if (level == "full") *policy = POLICY_FULL;
+  else if (level == "rough") *policy = POLICY_ROUGH_READS;
+  else if (level == "writes") *policy = POLICY_WRITES_ONLY;
+  else if (level == "off") *policy = POLICY_OFF;
+  else return false;
+  return true;
+}
+
+// Mirrors ShouldInstrumentModule and ShouldUseRoughReadChecks of dr_asan.cpp.
+static ImagePolicy DefaultImagePolicy(const string &img_name) {
   // Don't instrument libc -- it is too asan-hostile.
   // Also, parts of libc (e.g. memcpy) are called on shadow memory inside asan.
-  if (img_name.find("/libc") != string::npos) return;
+  if (img_name.find("/libc") != string::npos) return POLICY_OFF;
+  // Mesa crashes DRT under DrASan and Valgrind.
+  if (img_name.find("/libosmesa") != string::npos) return POLICY_OFF;
 
   if (img_name.find("pintest_so.so") == string::npos &&
       img_name.find("/usr/lib/") != 0 &&
       img_name.find("/lib/") != 0)
-    return;
+    return POLICY_OFF;
+
+  // https://bugs.kde.org/show_bug.cgi?id=269172
+  if (img_name.find("/libfontconfig") != string::npos)
+    return POLICY_ROUGH_READS;
+  // Valgrind detects weird reads in LD as well...
+  if (img_name.find("/ld-") != string::npos) return POLICY_ROUGH_READS;
+  return POLICY_FULL;
+}
+
+static ImagePolicy ChooseImagePolicy(const string &img_name) {
+  for (UINT32 i = 0; i < KnobPolicy.NumberOfValues(); i++) {
+    const string &rule = KnobPolicy.Value(i);
+    size_t colon = rule.find(':');
+    ImagePolicy policy;
+    if (colon == string::npos ||
+        !ParsePolicyLevel(rule.substr(0, colon), &policy)) {
+      fprintf(stderr, "asan_pin: bad -policy %s\n", rule.c_str());
+      PIN_ExitProcess(1);
+    }
+    if (img_name.find(rule.substr(colon + 1)) != string::npos)
+      return policy;
+  }
+  return DefaultImagePolicy(img_name);
+}
+
+void CallbackForTRACE(TRACE trace, void *v) {
+  RTN rtn = TRACE_Rtn(trace);
+  if (!RTN_Valid(rtn)) return;
+  IMG img = SEC_Img(RTN_Sec(rtn));
+  std::map<UINT32, ImagePolicy>::iterator it = image_policy.find(IMG_Id(img));
+  if (it == image_policy.end() || it->second == POLICY_OFF) return;
+  ImagePolicy policy = it->second;
+  string rtn_name = RTN_Name(rtn);
+  string img_name = IMG_Name(img);
   // printf("rtn: %s %s\n", rtn_name.c_str(), img_name.c_str());
   string *info = new string (rtn_name + " (" + img_name + ")");
 
@@ -86,6 +149,7 @@ void CallbackForTRACE(TRACE trace, void *v) {
       int n_mops = INS_MemoryOperandCount(ins);
       for (int i = 0; i < n_mops; i++) {
         bool is_write = INS_MemoryOperandIsWritten(ins, i);
+        if (!is_write && policy == POLICY_WRITES_ONLY) continue;
         size_t size = INS_MemoryOperandSize(ins, i);
         AFUNPTR callback1 = NULL, callback2 = NULL;
 #define SWITCH_CALLBACK(s, w, cb_if, cb_then) \
@@ -104,6 +168,8 @@ void CallbackForTRACE(TRACE trace, void *v) {
         SWITCH_CALLBACK(2,  false, access2_if,  load2_then);
         SWITCH_CALLBACK(1,  false, access1_if,  load1_then);
 #undef SWITCH_CALLBACK
+        if (!is_write && policy == POLICY_ROUGH_READS && callback1)
+          callback1 = (AFUNPTR)access_rough_if;
         if (callback1 && callback2) {
           INS_InsertIfCall(ins, IPOINT_BEFORE, callback1,
                            IARG_MEMORYOP_EA, i, IARG_END);
@@ -119,6 +185,12 @@ void CallbackForTRACE(TRACE trace, void *v) {
 }
 
 void CallbackForIMG(IMG img, void *v) {
+  image_policy[IMG_Id(img)] = ChooseImagePolicy(IMG_Name(img));
+  if (KnobVerbose.Value()) {
+    static const char *kPolicyName[] = {"off", "writes", "rough", "full"};
+    fprintf(stderr, "asan_pin: %s: %s\n", IMG_Name(img).c_str(),
+            kPolicyName[image_policy[IMG_Id(img)]]);
+  }
   for (SEC sec = IMG_SecHead(img); SEC_Valid(sec); sec = SEC_Next(sec)) {
     for (RTN rtn = SEC_RtnHead(sec); RTN_Valid(rtn); rtn = RTN_Next(rtn)) {
       string rtn_name = RTN_Name(rtn);
@@ -144,10 +216,15 @@ void CallbackForIMG(IMG img, void *v) {
   }
 }
 
+void CallbackForIMGUnload(IMG img, void *v) {
+  image_policy.erase(IMG_Id(img));
+}
+
 int main(INT32 argc, CHAR **argv) {
   PIN_Init(argc, argv);
   PIN_InitSymbols();
   IMG_AddInstrumentFunction(CallbackForIMG, 0);
+  IMG_AddUnloadFunction(CallbackForIMGUnload, 0);
   TRACE_AddInstrumentFunction(CallbackForTRACE, 0);
   PIN_StartProgram();
   return 0;
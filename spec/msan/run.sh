@@ -1,7 +1,13 @@
 #!/bin/bash
+# Usage: ./run.sh MODE ID [SIZE [benchmarks...]]
+# Runs in the background unless WAIT is set. SPEC_ACTION and SPEC_NOBUILD are
+# passed on to run_spec_clang.sh. run_matrix.sh runs all the modes and
+# compares them.
 MODE=$1
 ID=$2
 SIZE=${3:-ref}
+shift $(($# < 3 ? $# : 3))
+BMARKS=${*:-all_c all_cpp}
 
 VALGRIND=$HOME/valgrind-inst/bin/valgrind
 CLANG=$HOME/build/llvm/build/bin/clang
@@ -41,8 +47,12 @@ echo "CLANG=\"$CLANG\""
 echo "EXTRA_CFLAGS=\"$EXTRA_CFLAGS\""
 echo "SPEC_WRAPPER=\"$SPEC_WRAPPER\""
 echo "SIZE=\"$SIZE\""
+echo "BMARKS=\"$BMARKS\""
 
 export CLANG
 export EXTRA_CFLAGS
 export SPEC_WRAPPER
-./run_spec_clang.sh $ID $SIZE all_c all_cpp >& $ID.log &
+./run_spec_clang.sh $ID $SIZE $BMARKS >& $ID.log &
+if [[ z$WAIT != z ]]; then
+    wait
+fi
@@ -0,0 +1,161 @@
+#!/bin/bash
+# Runs CPU2006 in every mode of run.sh and compares each mode with the plain
+# clang build.
+# Run from the SPEC2006 folder, next to run.sh and run_spec_clang.sh:
+# $ ./run_matrix.sh [SIZE [benchmarks...]]
+# SIZE defaults to ref, benchmarks to all_c all_cpp.
+# MODES    modes to run, clang is always added (default: all of them)
+# REPS     runspec iterations of every benchmark (default 3)
+# CPUS     CPUs to pin the modes to with taskset, one mode per CPU at a time
+#          (default: all of them)
+# Every mode is built first, several at a time. Only then do the timed runs
+# start, with SPEC_NOBUILD=1 so that no build overlaps them.
+# PREFIX   the mode's ID is PREFIX-MODE (default mm)
+# OUT      where logs, results.csv and table.txt go (default msan-matrix)
+# For every benchmark, the time and peak RSS of each workload are the median
+# over the REPS iterations; time_s is the sum of the medians and maxrss the
+# largest of them. The table has the slowdown and the peak-RSS ratio against
+# clang, and their geometric means per mode.
+
+SIZE=${1:-ref}
+shift $(($# < 1 ? $# : 1))
+BMARKS=${*:-all_c all_cpp}
+
+me=$(basename $0)
+MODES=${MODES:-msan msan-origins msan-origins2 valgrind valgrind-origins}
+MODES="clang $(echo $MODES | tr ' ' '\n' | grep -vx clang | tr '\n' ' ')"
+REPS=${REPS:-3}
+CPUS=${CPUS:-$(seq -s ' ' 0 $(($(nproc) - 1)))}
+PREFIX=${PREFIX:-mm}
+OUT=${OUT:-msan-matrix}
+CPU_LIST=($CPUS)
+MODE_LIST=($MODES)
+
+if [[ ! -f ./shrc || ! -x ./run.sh ]]; then
+    echo >&2 "$me: run from the SPEC2006 folder, next to run.sh"
+    exit 1
+fi
+
+rm -rf $OUT
+mkdir -p $OUT
+
+# Several builds run at once, keep each of them narrow.
+export SPEC_J=${SPEC_J:-4}
+export NUM_RUNS=$REPS
+export WAIT=1
+
+# run_mode ACTION MODE CPU
+run_mode() {
+    local action=$1 mode=$2 cpu=$3 id=$PREFIX-$2
+    # These are ours, run.sh refuses to overwrite them.
+    rm -f $id.timelog $id.log
+    if [[ $action == build ]]; then
+        SPEC_ACTION=build ./run.sh $mode $id $SIZE $BMARKS \
+            > $OUT/$mode.build.out 2>&1
+        mv $id.log $OUT/$id.build.log 2>/dev/null
+        return
+    fi
+    SPEC_ACTION=run SPEC_NOBUILD=1 TASKSET="-c $cpu" \
+        ./run.sh $mode $id $SIZE $BMARKS > $OUT/$mode.out 2>&1
+    mv $id.timelog $id.log $OUT/ 2>/dev/null
+}
+
+run_phase() {
+    local action=$1 slot i
+    for ((slot = 0; slot < ${#CPU_LIST[@]}; slot++)); do
+        (
+            for ((i = slot; i < ${#MODE_LIST[@]}; i += ${#CPU_LIST[@]})); do
+                run_mode $action ${MODE_LIST[i]} ${CPU_LIST[slot]}
+            done
+        ) &
+    done
+    wait
+}
+
+echo "$me: building ${#MODE_LIST[@]} modes on ${#CPU_LIST[@]} CPUs"
+run_phase build
+echo "$me: running, $REPS reps"
+run_phase run
+
+# Timelog lines are "%e %M %C". The benchmark is the word of the command
+# that names its binary (bzip2_base.ID), valgrind's options come before it.
+echo "bench,mode,time_s,maxrss_kb" > $OUT/results.csv
+for mode in $MODES; do
+    timelog=$OUT/$PREFIX-$mode.timelog
+    if [[ ! -s $timelog ]]; then
+        echo >&2 "$me: no timings for $mode, see $OUT/$PREFIX-$mode.log"
+        continue
+    fi
+    awk -v mode=$mode '
+        function median(list,    v, n, i, j, t) {
+            n = split(list, v, " ")
+            for (i = 2; i <= n; i++)
+                for (j = i; j > 1 && v[j - 1] + 0 > v[j] + 0; j--) {
+                    t = v[j]; v[j] = v[j - 1]; v[j - 1] = t
+                }
+            return n % 2 ? v[(n + 1) / 2] : (v[n / 2] + v[n / 2 + 1]) / 2
+        }
+        $1 !~ /^[0-9.]+$/ { next }
+        {
+            bench = ""
+            for (i = 3; i <= NF; i++) {
+                if ($i ~ /_base\./) {
+                    bench = $i
+                    sub(/.*\//, "", bench)
+                    sub(/_base\..*/, "", bench)
+                    break
+                }
+            }
+            if (bench == "") next
+            cmd = $0
+            sub(/^[^ ]+ [^ ]+ /, "", cmd)
+            key = bench SUBSEP cmd
+            if (!(key in times)) order[++n] = key
+            times[key] = times[key] " " $1
+            rss[key] = rss[key] " " $2
+        }
+        END {
+            for (i = 1; i <= n; i++) {
+                split(order[i], k, SUBSEP)
+                if (!(k[1] in total)) benches[++nb] = k[1]
+                total[k[1]] += median(times[order[i]])
+                r = median(rss[order[i]])
+                if (r > peak[k[1]]) peak[k[1]] = r
+            }
+            for (i = 1; i <= nb; i++)
+                printf "%s,%s,%.2f,%d\n", benches[i], mode, total[benches[i]],
+                       peak[benches[i]]
+        }' $timelog >> $OUT/results.csv
+done
+
+awk -F, '
+    NR == 1 { next }
+    { row[NR] = $0 }
+    $2 == "clang" { base_time[$1] = $3; base_rss[$1] = $4 }
+    END {
+        printf "%-16s %-18s %10s %9s %12s %9s\n", "bench", "mode", "time_s",
+               "slowdown", "maxrss_mb", "mem_x"
+        for (i = 2; i <= NR; i++) {
+            split(row[i], f, ",")
+            slow = mem = "-"
+            if (base_time[f[1]] > 0 && f[3] > 0) {
+                slow = sprintf("%.2f", f[3] / base_time[f[1]])
+                slow_log[f[2]] += log(f[3] / base_time[f[1]])
+                slow_n[f[2]]++
+            }
+            if (base_rss[f[1]] > 0 && f[4] > 0) {
+                mem = sprintf("%.2f", f[4] / base_rss[f[1]])
+                mem_log[f[2]] += log(f[4] / base_rss[f[1]])
+                mem_n[f[2]]++
+            }
+            if (!(f[2] in seen)) { seen[f[2]] = 1; modes[++nm] = f[2] }
+            printf "%-16s %-18s %10.2f %9s %12.1f %9s\n", f[1], f[2], f[3],
+                   slow, f[4] / 1024, mem
+        }
+        for (i = 1; i <= nm; i++) {
+            m = modes[i]
+            printf "%-16s %-18s %10s %9s %12s %9s\n", "geomean", m, "",
+                   slow_n[m] ? sprintf("%.2f", exp(slow_log[m] / slow_n[m])) : "-",
+                   "", mem_n[m] ? sprintf("%.2f", exp(mem_log[m] / mem_n[m])) : "-"
+        }
+    }' $OUT/results.csv | tee $OUT/table.txt
@@ -8,6 +8,8 @@
 # parallel.
 # test is a small data set, train is medium, ref is large.
 # To run all C use all_c, for C++ use all_cpp
+# SPEC_ACTION=build only builds; SPEC_NOBUILD=1 then runs those binaries
+# without ever rebuilding them (runspec --nobuild).
 
 name=$1
 shift
@@ -21,7 +23,16 @@ NUM_RUNS=${NUM_RUNS:-1}
 CLANG=${CLANG:-clang}
 BIT=${BIT:-64}
 OPT_LEVEL=${OPT_LEVEL:-"-O2"}
+SPEC_ACTION=${SPEC_ACTION:-run}
 
+# runspec appends the MD5 of the binaries it built to the cfg, keep it for
+# --nobuild or every binary looks out of date.
+MD5_SECTION=
+NOBUILD=
+if [ "$SPEC_NOBUILD" == "1" ]; then
+  MD5_SECTION=$(sed -n '/^__MD5__$/,$p' config/$name.cfg 2>/dev/null)
+  NOBUILD=--nobuild
+fi
 rm -rf config/$name.*
 
 COMMON_FLAGS="-m$BIT -g $EXTRA_CFLAGS"
@@ -65,8 +76,11 @@ CXXPORTABILITY= -DSPEC_CPU_LINUX -include string.h
 447.dealII=default=default=default:
 CXXPORTABILITY= -include string.h -include stdlib.h -include cstddef
 EOF
+if [ -n "$MD5_SECTION" ]; then
+  echo "$MD5_SECTION" >> config/$name.cfg
+fi
 
 # Don't report alloc-dealloc-mismatch bugs (there is on in 471.omnetpp)
 export ASAN_OPTIONS=alloc_dealloc_mismatch=0
 . shrc
-runspec -c $name -a run -I -l --size $size -n $NUM_RUNS $@
+runspec -c $name -a $SPEC_ACTION $NOBUILD -I -l --size $size -n $NUM_RUNS $@
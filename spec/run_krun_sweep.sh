@@ -0,0 +1,197 @@
+#!/bin/bash
+
+# Sweep krun's instrumentation knobs and ASAN_OPTIONS over CPU2006 and
+# compare every configuration with the full-check default.
+# Run this script from the SPEC2006 folder, next to krun:
+# $ ./run_krun_sweep.sh benchmarks...
+# Pass individual benchmarks (perlbench bzip2 ...) rather than all_c/all_cpp:
+# every (configuration, benchmark) pair gets its own TAG and its own row.
+# A configuration is NAME:KNOBS:OPTIONS, KNOBS being comma-separated krun
+# variables and OPTIONS extra ASAN_OPTIONS, e.g.
+#   nocall:ASAN_CALL=0:   q16::quarantine_size_mb=16
+# Configurations:
+#   default     krun's defaults, every read and write checked
+#   noasan      ENABLE_ASAN=0, for reference
+# plus, with SWEEP=one (the default), one configuration per word of KNOBS
+# changing just that knob, or with SWEEP=full one per combination of them.
+# RT_VARIANTS adds NAME:OPTIONS runtime variants of the default build, and
+# CONFIGS any further NAME:KNOBS:OPTIONS configurations.
+# SIZES (default "test train") are run one after another for every pair.
+# All pairs are built in parallel first, then run in parallel with
+# SPEC_NOBUILD=1, one slot per CPU in CPUS (default: all of them), pinned with
+# taskset. Per-run logs, results.csv and table.txt go to OUT
+# (default krun-sweep).
+
+me=$(basename $0)
+
+usage() {
+  echo >&2 "Usage: $me bmarks"
+  exit 1
+}
+
+if [ $# -eq 0 ]; then
+  usage
+fi
+
+if [ ! -f ./shrc ]; then
+  echo >&2 "$me: script must be run from SPEC2006 folder"
+  exit 1
+fi
+
+KRUN=${KRUN:-./krun}
+OUT=${OUT:-krun-sweep}
+SIZES=${SIZES:-test train}
+SWEEP=${SWEEP:-one}
+KNOBS=${KNOBS:-ASAN_CALL=0 ASAN_STACK=0 ASAN_OPT=0 ASAN_READS=0 ASAN_WRITES=0 ENABLE_BBPLACEMENT=1}
+CPUS=${CPUS:-$(seq -s ' ' 0 $(($(nproc) - 1)))}
+CPU_LIST=($CPUS)
+
+for size in $SIZES; do
+  case "$size" in
+    test|train|ref)
+      ;;
+    *)
+      echo >&2 "$me: unexpected size: $size"
+      usage
+      ;;
+  esac
+done
+
+# ASAN_CALL=0 -> call0, ENABLE_BBPLACEMENT=1 -> bbplacement1
+knob_name() {
+  echo $1 | tr A-Z a-z | sed -e 's/^asan_//' -e 's/^enable_//' -e 's/=//'
+}
+
+ALL_CONFIGS="default:: noasan:ENABLE_ASAN=0:"
+case "$SWEEP" in
+  one)
+    for knob in $KNOBS; do
+      ALL_CONFIGS="$ALL_CONFIGS $(knob_name $knob):$knob:"
+    done
+    ;;
+  full)
+    # Every subset of KNOBS, as "name-name:KNOB,KNOB" words.
+    subsets=":"
+    for knob in $KNOBS; do
+      for s in $subsets; do
+        name=${s%%:*} knobs=${s#*:}
+        subsets="$subsets ${name:+$name-}$(knob_name $knob):${knobs:+$knobs,}$knob"
+      done
+    done
+    for s in $subsets; do
+      [ "$s" != ":" ] && ALL_CONFIGS="$ALL_CONFIGS $s:"
+    done
+    ;;
+  *)
+    echo >&2 "$me: SWEEP must be one or full"
+    exit 1
+    ;;
+esac
+for variant in $RT_VARIANTS; do
+  ALL_CONFIGS="$ALL_CONFIGS ${variant%%:*}::${variant#*:}"
+done
+ALL_CONFIGS="$ALL_CONFIGS $CONFIGS"
+
+rm -rf $OUT
+mkdir -p $OUT
+OUT=$(cd $OUT && pwd)
+
+# Every job is "NAME:KNOBS:OPTIONS BENCHMARK".
+JOBS=()
+for bench in "$@"; do
+  for config in $ALL_CONFIGS; do
+    JOBS+=("$config $bench")
+  done
+done
+
+# run_job ACTION CPU NAME:KNOBS:OPTIONS BENCHMARK
+run_job() {
+  local action=$1 cpu=$2 name=${3%%:*} rest=${3#*:} bench=$4
+  local knobs=${rest%%:*} options=${rest#*:}
+  local dir=$OUT/$name/$bench size
+  mkdir -p $dir
+  if [ "$action" == "build" ]; then
+    env $(echo $knobs | tr , ' ') SPEC_ACTION=build \
+      $KRUN s-$name-$bench test $bench >> $dir/build.log 2>&1
+    return
+  fi
+  for size in $SIZES; do
+    env $(echo $knobs | tr , ' ') SPEC_ACTION=run SPEC_NOBUILD=1 \
+      ASAN_OPTIONS="$options" \
+      SPEC_WRAPPER="taskset -c $cpu /usr/bin/time -f '%e %M' -o $dir/time.$size.log -a" \
+      $KRUN s-$name-$bench $size $bench >> $dir/run.log 2>&1
+  done
+}
+
+run_phase() {
+  local action=$1 slot i
+  for ((slot = 0; slot < ${#CPU_LIST[@]}; slot++)); do
+    (
+      for ((i = slot; i < ${#JOBS[@]}; i += ${#CPU_LIST[@]})); do
+        run_job $action ${CPU_LIST[slot]} ${JOBS[i]}
+      done
+    ) &
+  done
+  wait
+}
+
+echo "$me: building ${#JOBS[@]} configurations on ${#CPU_LIST[@]} CPUs"
+run_phase build
+echo "$me: running $SIZES"
+run_phase run
+
+# results.csv: one row per (benchmark, configuration, size), summed over all
+# the workloads of the benchmark; maxrss is the largest of them.
+echo "bench,config,size,time_s,maxrss_kb" > $OUT/results.csv
+for job in "${JOBS[@]}"; do
+  set -- $job
+  name=${1%%:*}
+  bench=$2
+  for size in $SIZES; do
+    log=$OUT/$name/$bench/time.$size.log
+    if [ ! -s $log ]; then
+      echo >&2 "$me: no $size timings for $name $bench, see $OUT/$name/$bench"
+      continue
+    fi
+    awk -v prefix="$bench,$name,$size" '
+      NF == 2 && $1 ~ /^[0-9.]+$/ {
+        time += $1
+        if ($2 > rss) rss = $2
+      }
+      END { printf "%s,%.2f,%d\n", prefix, time, rss }' $log >> $OUT/results.csv
+  done
+done
+
+# Ratios are against default; the geomean rows summarize every
+# (configuration, size) over the benchmarks.
+awk -F, '
+  NR == 1 { next }
+  { row[NR] = $0 }
+  $2 == "default" { base_time[$1, $3] = $4; base_rss[$1, $3] = $5 }
+  END {
+    printf "%-16s %-28s %-6s %10s %8s %12s %8s\n", "bench", "config", "size",
+           "time_s", "time_x", "maxrss_mb", "mem_x"
+    for (i = 2; i <= NR; i++) {
+      split(row[i], f, ",")
+      key = f[2] SUBSEP f[3]
+      if (!(key in n)) order[++nk] = key
+      t = base_time[f[1], f[3]] > 0 && f[4] > 0 ? f[4] / base_time[f[1], f[3]] : 0
+      m = base_rss[f[1], f[3]] > 0 && f[5] > 0 ? f[5] / base_rss[f[1], f[3]] : 0
+      if (t && m) {
+        time_log[key] += log(t)
+        mem_log[key] += log(m)
+        n[key]++
+      } else if (!(key in n)) {
+        n[key] = 0
+      }
+      printf "%-16s %-28s %-6s %10.2f %8s %12.1f %8s\n", f[1], f[2], f[3],
+             f[4], t ? sprintf("%.3f", t) : "-", f[5] / 1024,
+             m ? sprintf("%.3f", m) : "-"
+    }
+    for (i = 1; i <= nk; i++) {
+      split(order[i], k, SUBSEP)
+      printf "%-16s %-28s %-6s %10s %8s %12s %8s\n", "geomean", k[1], k[2], "",
+             n[order[i]] ? sprintf("%.3f", exp(time_log[order[i]] / n[order[i]])) : "-",
+             "", n[order[i]] ? sprintf("%.3f", exp(mem_log[order[i]] / n[order[i]])) : "-"
+    }
+  }' $OUT/results.csv | tee $OUT/table.txt
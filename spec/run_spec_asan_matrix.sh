@@ -0,0 +1,158 @@
+#!/bin/bash
+
+# Run CPU2006 in several ASan configurations in one pass and compare them
+# with a non-instrumented baseline.
+# Run this script from the SPEC2006 folder, next to run_spec_clang_asan.sh:
+# $ ./run_spec_asan_matrix.sh size benchmarks...
+# Pass individual benchmarks (perlbench bzip2 ...) rather than all_c/all_cpp:
+# every (configuration, benchmark) pair gets its own TAG and its own row.
+# Configurations:
+#   base        no instrumentation (ENABLE_ASAN=0)
+#   asan        -fsanitize=address with run_spec_clang_asan.sh's defaults
+#   asan-leaks  asan, run with detect_leaks=1
+# plus one per NAME:OPTIONS word in ASAN_VARIANTS, which runs an asan build
+# with the given ASAN_OPTIONS, e.g.
+#   ASAN_VARIANTS="q16:quarantine_size_mb=16 slowunwind:fast_unwind_on_malloc=0"
+# All pairs are built in parallel first. Then they run in parallel, with
+# SPEC_NOBUILD=1 so that nothing gets rebuilt, one slot per CPU in CPUS
+# (default: all of them), each slot pinned with taskset. The slots take the
+# pairs round-robin, so all configurations of a benchmark run at the same
+# time.
+# Every run is wrapped in /usr/bin/time and, unless PERF_EVENTS is empty,
+# perf stat. Per-run logs, results.csv and table.txt (slowdown and memory
+# overhead against base) go to OUT (default asan-matrix).
+
+size=$1
+shift
+
+me=$(basename $0)
+
+usage() {
+  echo >&2 "Usage: $me size bmarks"
+  exit 1
+}
+
+case "$size" in
+  test|train|ref)
+    ;;
+  *)
+    echo >&2 "$me: unexpected size: $size"
+    usage
+    ;;
+esac
+
+if [ $# -eq 0 ]; then
+  usage
+fi
+
+if [ ! -f ./shrc ]; then
+  echo >&2 "$me: script must be run from SPEC2006 folder"
+  exit 1
+fi
+
+RUNNER=${RUNNER:-./run_spec_clang_asan.sh}
+OUT=${OUT:-asan-matrix}
+CPUS=${CPUS:-$(seq -s ' ' 0 $(($(nproc) - 1)))}
+PERF_EVENTS=${PERF_EVENTS-cycles,instructions,cache-misses,page-faults}
+# Many builds run at once, keep each of them narrow.
+export SPEC_J=${SPEC_J:-2}
+
+CONFIGS="base: asan: asan-leaks:detect_leaks=1 $ASAN_VARIANTS"
+CPU_LIST=($CPUS)
+
+rm -rf $OUT
+mkdir -p $OUT
+OUT=$(cd $OUT && pwd)
+
+# Every job is "CONFIG:OPTIONS BENCHMARK".
+JOBS=()
+for bench in "$@"; do
+  for config in $CONFIGS; do
+    JOBS+=("$config $bench")
+  done
+done
+
+# run_job ACTION CPU CONFIG:OPTIONS BENCHMARK
+# Every pair has its own TAG, so no two runspec instances share a config or
+# a run directory, even for configurations with identical binaries.
+run_job() {
+  local action=$1 cpu=$2 config=${3%%:*} options=${3#*:} bench=$4
+  local dir=$OUT/$config/$bench
+  local enable=1 wrapper= nobuild=
+  if [ "$config" == "base" ]; then
+    enable=0
+  fi
+  # The run phase must not rebuild anything next to the timed runs.
+  if [ "$action" == "run" ]; then
+    nobuild=1
+    wrapper="taskset -c $cpu /usr/bin/time -f '%e %M' -o $dir/time.log -a"
+    if [ -n "$PERF_EVENTS" ]; then
+      wrapper="$wrapper perf stat -x, -e $PERF_EVENTS -o $dir/perf.log --append"
+    fi
+  fi
+  mkdir -p $dir
+  ENABLE_ASAN=$enable SPEC_ACTION=$action SPEC_NOBUILD=$nobuild \
+    SPEC_WRAPPER="$wrapper" \
+    ASAN_OPTIONS="$options" $RUNNER m-$config-$bench $size $bench \
+    >> $dir/$action.log 2>&1
+}
+
+run_phase() {
+  local action=$1 slot i
+  for ((slot = 0; slot < ${#CPU_LIST[@]}; slot++)); do
+    (
+      for ((i = slot; i < ${#JOBS[@]}; i += ${#CPU_LIST[@]})); do
+        run_job $action ${CPU_LIST[slot]} ${JOBS[i]}
+      done
+    ) &
+  done
+  wait
+}
+
+echo "$me: building ${#JOBS[@]} configurations on ${#CPU_LIST[@]} CPUs"
+run_phase build
+echo "$me: running"
+run_phase run
+
+# results.csv: one row per (benchmark, configuration), summed over all the
+# workloads of the benchmark; maxrss is the largest of them.
+echo "bench,config,time_s,maxrss_kb${PERF_EVENTS:+,$PERF_EVENTS}" > $OUT/results.csv
+for job in "${JOBS[@]}"; do
+  set -- $job
+  config=${1%%:*}
+  bench=$2
+  dir=$OUT/$config/$bench
+  if [ ! -s $dir/time.log ]; then
+    echo >&2 "$me: no timings for $config $bench, see $dir/run.log"
+    continue
+  fi
+  awk -F'[ ,]' -v bench=$bench -v config=$config -v events=$PERF_EVENTS '
+    FILENAME ~ /time.log$/ && NF == 2 && $1 ~ /^[0-9.]+$/ {
+      time += $1
+      if ($2 > rss) rss = $2
+    }
+    FILENAME ~ /perf.log$/ && $1 ~ /^[0-9]+$/ { count[$3] += $1 }
+    END {
+      printf "%s,%s,%.2f,%d", bench, config, time, rss
+      n = split(events, ev, ",")
+      for (i = 1; i <= n; i++) printf ",%.0f", count[ev[i]]
+      printf "\n"
+    }' $dir/time.log $(ls $dir/perf.log 2>/dev/null) >> $OUT/results.csv
+done
+
+awk -F, '
+  NR == 1 { next }
+  { row[NR] = $0 }
+  $2 == "base" { base_time[$1] = $3; base_rss[$1] = $4 }
+  END {
+    printf "%-16s %-14s %10s %9s %12s %9s\n", "bench", "config", "time_s",
+           "slowdown", "maxrss_mb", "mem_x"
+    for (i = 2; i <= NR; i++) {
+      if (!(i in row)) continue
+      split(row[i], f, ",")
+      slow = base_time[f[1]] ? sprintf("%.2f", f[3] / base_time[f[1]]) : "-"
+      mem = base_rss[f[1]] ? sprintf("%.2f", f[4] / base_rss[f[1]]) : "-"
+      printf "%-16s %-14s %10.2f %9s %12.1f %9s\n", f[1], f[2], f[3], slow,
+             f[4] / 1024, mem
+    }
+  }' $OUT/results.csv | tee $OUT/table.txt
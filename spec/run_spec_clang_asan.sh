@@ -10,6 +10,9 @@
 # ref is large.
 # To run all C tests use all_c, for C++ use all_cpp. To run integer tests
 # use int, for floating point use fp.
+# Set ENABLE_ASAN=0 to build a non-instrumented baseline with the same flags,
+# and SPEC_ACTION=build to only build the benchmarks. SPEC_NOBUILD=1 then runs
+# those binaries without ever rebuilding them (runspec --nobuild).
 
 name=$1
 shift
@@ -45,6 +48,8 @@ ulimit -s 8092  # stack
 
 SPEC_J=${SPEC_J:-20}
 NUM_RUNS=${NUM_RUNS:-1}
+ENABLE_ASAN=${ENABLE_ASAN:-1}
+SPEC_ACTION=${SPEC_ACTION:-run}
 CC=${CC:-clang}
 BIT=${BIT:-64}
 OPT_LEVEL=${OPT_LEVEL:-"-O2"}
@@ -56,6 +61,17 @@ else
   CXX=${CXX:-$(echo $CC | sed -e 's/gcc$/g++/')}
   export LD_LIBRARY_PATH=$($CC -print-search-dirs | sed -ne 's/^libraries: =//p')${LD_LIBRARY_PATH:+:$LD_LIBRARY_PATH}
 fi
+if [ "$ENABLE_ASAN" == "0" ]; then
+  F_ASAN=
+fi
+# runspec appends the MD5 of the binaries it built to the cfg. Without it
+# every binary looks out of date, so keep it for --nobuild.
+MD5_SECTION=
+NOBUILD=
+if [ "$SPEC_NOBUILD" == "1" ]; then
+  MD5_SECTION=$(sed -n '/^__MD5__$/,$p' config/$name.cfg 2>/dev/null)
+  NOBUILD=--nobuild
+fi
 rm -rf config/$name.*
 
 if test -z "$FC"; then
@@ -105,8 +121,11 @@ CXXPORTABILITY= -DSPEC_CPU_LINUX -include string.h
 447.dealII=default=default=default:
 CXXPORTABILITY= -include string.h -include stdlib.h -include cstddef
 EOF
+if [ -n "$MD5_SECTION" ]; then
+  echo "$MD5_SECTION" >> config/$name.cfg
+fi
 
 # Don't report alloc-dealloc-mismatch bugs (there is on in 471.omnetpp) and leaks
 export ASAN_OPTIONS=alloc_dealloc_mismatch=0:detect_leaks=0${ASAN_OPTIONS:+:$ASAN_OPTIONS}
 . shrc
-runspec -c $name -a run -I -l --size $size -n $NUM_RUNS $@
+runspec -c $name -a $SPEC_ACTION $NOBUILD -I -l --size $size -n $NUM_RUNS $@
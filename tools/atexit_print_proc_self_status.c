@@ -1,28 +1,216 @@
+#include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <time.h>
 #include <unistd.h>
-#include <assert.h>
 
-// At exit, print the contents of /proc/self/status tp proc_status.$pid.
+// Sample the memory and CPU usage of the process over its whole run.
+// A background thread wakes up every $PROC_SAMPLE_MS milliseconds (default
+// 100, 0 disables sampling) and appends one line to proc_samples.$pid:
+//   ms rss_kb hwm_kb shadow_kb anon_kb pss_kb minflt majflt utime_ms stime_ms
+// rss/hwm come from /proc/self/status, anon/pss from /proc/self/smaps_rollup.
+// shadow_kb is the resident part of the ASan shadow, summed over the
+// /proc/self/smaps entries inside the range given as $PROC_SAMPLE_SHADOW (hex
+// begin-end, any other value means x86_64 ASan's 7fff8000-10007fff8000).
+// The whole smaps is too slow to read at every sample of a benchmark, so
+// without PROC_SAMPLE_SHADOW it isn't read and shadow_kb is "-".
+// At exit, take a last sample and print the contents of /proc/self/status to
+// proc_status.$pid.
 // Build:
-//  gcc atexit_print_proc_self_status.c -shared -fPIC -o  atexit_print_proc_self_status.so
+//  gcc atexit_print_proc_self_status.c -shared -fPIC -pthread -o  atexit_print_proc_self_status.so
 // Use:
 //  LD_PRELOAD=`pwd`/atexit_print_proc_self_status.so your-program
 
+typedef struct {
+  unsigned long rss_kb, hwm_kb, shadow_kb, anon_kb, pss_kb;
+} MemSample;
+
+static pthread_mutex_t sample_mu = PTHREAD_MUTEX_INITIALIZER;
+static int samples_fd = -1;
+static unsigned long interval_ms = 100;
+static int sample_shadow = 0;
+static unsigned long shadow_beg = 0x7fff8000UL;
+static unsigned long shadow_end = 0x10007fff8000UL;
+static struct timespec start_time;
+
+// Calls cb for every line of path. Uses a stack buffer rather than stdio so
+// that sampling doesn't allocate inside the process being measured.
+static void for_each_line(const char *path,
+                          void (*cb)(char *line, MemSample *s), MemSample *s) {
+  char buf[8192];
+  size_t len = 0;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return;
+  for (;;) {
+    ssize_t n = read(fd, buf + len, sizeof(buf) - 1 - len);
+    if (n <= 0) break;
+    len += n;
+    buf[len] = 0;
+    char *line = buf, *nl;
+    while ((nl = strchr(line, '\n'))) {
+      *nl = 0;
+      cb(line, s);
+      line = nl + 1;
+    }
+    len -= line - buf;
+    memmove(buf, line, len);
+    if (len == sizeof(buf) - 1) len = 0;  // Drop overlong lines.
+  }
+  close(fd);
+}
+
+static int parse_field(const char *line, const char *name,
+                       unsigned long *value) {
+  size_t len = strlen(name);
+  if (strncmp(line, name, len)) return 0;
+  *value = strtoul(line + len, NULL, 10);
+  return 1;
+}
+
+static void parse_status_line(char *line, MemSample *s) {
+  if (!parse_field(line, "VmRSS:", &s->rss_kb))
+    parse_field(line, "VmHWM:", &s->hwm_kb);
+}
+
+static void parse_rollup_line(char *line, MemSample *s) {
+  if (!parse_field(line, "Anonymous:", &s->anon_kb))
+    parse_field(line, "Pss:", &s->pss_kb);
+}
+
+static int in_shadow;
+
+// Mapping headers start with a lowercase hex address, fields with a
+// capitalized name.
+static void parse_smaps_line(char *line, MemSample *s) {
+  unsigned long rss;
+  if (isdigit(line[0]) || (line[0] >= 'a' && line[0] <= 'f')) {
+    char *end;
+    unsigned long beg = strtoul(line, &end, 16);
+    unsigned long last = strtoul(end + 1, NULL, 16);
+    in_shadow = beg < shadow_end && last > shadow_beg;
+  } else if (in_shadow && parse_field(line, "Rss:", &rss)) {
+    s->shadow_kb += rss;
+  }
+}
+
+static unsigned long timeval_ms(struct timeval tv) {
+  return tv.tv_sec * 1000UL + tv.tv_usec / 1000;
+}
+
+// Must be called with sample_mu held.
+static void take_sample() {
+  MemSample s;
+  struct rusage ru;
+  struct timespec now;
+  char line[256], shadow[32] = "-";
+  if (samples_fd < 0) return;
+  memset(&s, 0, sizeof(s));
+  for_each_line("/proc/self/status", parse_status_line, &s);
+  for_each_line("/proc/self/smaps_rollup", parse_rollup_line, &s);
+  if (sample_shadow) {
+    in_shadow = 0;
+    for_each_line("/proc/self/smaps", parse_smaps_line, &s);
+    snprintf(shadow, sizeof(shadow), "%lu", s.shadow_kb);
+  }
+  getrusage(RUSAGE_SELF, &ru);
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long ms = (now.tv_sec - start_time.tv_sec) * 1000L +
+            (now.tv_nsec - start_time.tv_nsec) / 1000000;
+  int len = snprintf(line, sizeof(line),
+                     "%ld %lu %lu %s %lu %lu %lu %lu %lu %lu\n", ms,
+                     s.rss_kb, s.hwm_kb, shadow, s.anon_kb, s.pss_kb,
+                     (unsigned long)ru.ru_minflt, (unsigned long)ru.ru_majflt,
+                     timeval_ms(ru.ru_utime), timeval_ms(ru.ru_stime));
+  if (write(samples_fd, line, len) != len) {
+    close(samples_fd);
+    samples_fd = -1;
+  }
+}
+
+static void *sampler_thread(void *unused) {
+  struct timespec interval = {interval_ms / 1000,
+                              (interval_ms % 1000) * 1000000};
+  for (;;) {
+    nanosleep(&interval, NULL);
+    pthread_mutex_lock(&sample_mu);
+    take_sample();
+    pthread_mutex_unlock(&sample_mu);
+  }
+  return unused;
+}
+
+static void start_sampler() {
+  char name[64];
+  pthread_t thread;
+  sigset_t all, old;
+  if (!interval_ms) return;
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  sprintf(name, "proc_samples.%d", getpid());
+  samples_fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (samples_fd < 0) return;
+  const char *header = "# ms rss_kb hwm_kb shadow_kb anon_kb pss_kb minflt "
+                       "majflt utime_ms stime_ms\n";
+  if (write(samples_fd, header, strlen(header)) < 0) return;
+  // Keep the application's signals off the sampler thread.
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  if (pthread_create(&thread, NULL, sampler_thread, NULL) == 0)
+    pthread_detach(thread);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
 static void print_proc_self_status() {
   char buff[4096];
+  size_t n;
+  pthread_mutex_lock(&sample_mu);
+  take_sample();
+  if (samples_fd >= 0) close(samples_fd);
+  samples_fd = -1;
+  pthread_mutex_unlock(&sample_mu);
+
   FILE *status = fopen("/proc/self/status", "r");
-  assert(status);
+  if (!status) return;
   sprintf(buff, "proc_status.%d", getpid());
   FILE *out = fopen(buff, "w");
-  assert(out);
-  fread(buff, 1, sizeof(buff), status);
-  fprintf(out, "%s\b", buff);
+  if (!out) {
+    fclose(status);
+    return;
+  }
+  while ((n = fread(buff, 1, sizeof(buff), status)) > 0)
+    fwrite(buff, 1, n, out);
   fclose(status);
   fclose(out);
 }
 
+// Don't fork while the sampler is mid-sample; the child gets its own series.
+static void before_fork() { pthread_mutex_lock(&sample_mu); }
+static void after_fork_parent() { pthread_mutex_unlock(&sample_mu); }
+static void after_fork_child() {
+  if (samples_fd >= 0) close(samples_fd);
+  samples_fd = -1;
+  pthread_mutex_unlock(&sample_mu);
+  start_sampler();
+}
+
 __attribute__((constructor)) static void register_print_proc_self_status() {
+  const char *env = getenv("PROC_SAMPLE_MS");
+  if (env) interval_ms = strtoul(env, NULL, 10);
+  env = getenv("PROC_SAMPLE_SHADOW");
+  if (env) {
+    char *end;
+    sample_shadow = 1;
+    unsigned long beg = strtoul(env, &end, 16);
+    if (*end == '-') {
+      shadow_beg = beg;
+      shadow_end = strtoul(end + 1, NULL, 16);
+    }
+  }
+  pthread_atfork(before_fork, after_fork_parent, after_fork_child);
+  start_sampler();
   atexit(print_proc_self_status);
 }
@@ -1,9 +1,13 @@
 #!/usr/bin/python
 
+import hashlib
+import json
 import os
 import re
 import sys
 import subprocess
+import threading
+from multiprocessing.pool import ThreadPool
 
 time_re = re.compile(
   '^(?P<time>\[[ ]*[0-9\.]+\]) ?(?P<suffix>.*)$'
@@ -26,12 +30,28 @@ nm_re = re.compile(
   '^(?P<offset>[0-9A-Fa-f]+) [a-zA-Z] (?P<symbol>[^ ]+)$'
 )
 
+build_id_re = re.compile(
+  'Build ID: (?P<build_id>[0-9A-Fa-f]+)'
+)
+
+# Reports are symbolized in batches: everything up to the next KASAN report
+# separator, or at most this many lines.
+report_separator_re = re.compile('^=+$')
+MAX_BATCH_LINES = 10000
+
+SENTINEL_ADDR = 'ffffffffffffffff'
+
 def print_usage():
   print 'Usage: %s <linux path> [<strip path>]' % sys.argv[0]
+  print 'The module index and nm output are cached in $KASAN_SYMBOLIZE_CACHE'
+  print '(default ~/.cache/kasan_symbolize), set it to "" to disable caching.'
+  print 'If $KASAN_SYMBOLIZER points to internal_symbolizer/kasan_symbolizer,'
+  print 'the whole input is handed over to it instead.'
 
 class Symbolizer:
   def __init__(self, binary_path):
-    self.proc = subprocess.Popen(['addr2line', '-f', '-i', '-e', binary_path],
+    self.proc = subprocess.Popen(['addr2line', '-a', '-f', '-i',
+                                  '-e', binary_path],
                                  stdin=subprocess.PIPE, stdout=subprocess.PIPE)
 
   def __enter__(self):
@@ -40,56 +60,148 @@ class Symbolizer:
   def __exit__(self, type, value, traceback):
     self.Close()
 
-  def Process(self, addr):
-    self.proc.stdin.write(addr + '\n')
-    self.proc.stdin.write('ffffffffffffffff\n')
-    self.proc.stdin.flush()
-
-    result = []
-    while True:
-      func = self.proc.stdout.readline().rstrip()
-      fileline = self.proc.stdout.readline().rstrip()
-      if func == '??':
-        if len(result) == 0:
-          self.proc.stdout.readline()
-          self.proc.stdout.readline()
-        return result
-      result.append((func, fileline))
+  # Symbolizes all addrs in one round trip. Returns a list of (func, fileline)
+  # lists, innermost inlined frame first, in the order of addrs.
+  def ProcessBatch(self, addrs):
+    # addr2line answers while we are still writing, so feed it from another
+    # thread to keep both pipes from filling up.
+    request = ''.join(addr + '\n' for addr in addrs + [SENTINEL_ADDR])
+    def Write():
+      self.proc.stdin.write(request)
+      self.proc.stdin.flush()
+    writer = threading.Thread(target=Write)
+    writer.start()
+
+    # With -a every answer starts with the queried address.
+    results = []
+    line = self.proc.stdout.readline()
+    while int(line, 16) != int(SENTINEL_ADDR, 16):
+      result = []
+      while True:
+        line = self.proc.stdout.readline()
+        if line.startswith('0x'):
+          break
+        func = line.rstrip()
+        fileline = self.proc.stdout.readline().rstrip()
+        if func != '??':
+          result.append((func, fileline))
+      results.append(result)
+    # The sentinel itself symbolizes to '??' and '??:0'.
+    self.proc.stdout.readline()
+    self.proc.stdout.readline()
+    writer.join()
+    return results
 
   def Close(self):
     self.proc.kill()
     self.proc.wait()
 
-def FindFile(path, name):
-  for root, dirs, files in os.walk(path):
-    if name in files:
-      return os.path.join(root, name)
-  return None
+def LoadJson(path):
+  try:
+    with open(path) as f:
+      return json.load(f)
+  except (IOError, ValueError):
+    return None
+
+def SaveJson(path, data):
+  try:
+    if not os.path.isdir(os.path.dirname(path)):
+      os.makedirs(os.path.dirname(path))
+    # Write and rename, so that concurrent runs never read a partial file.
+    tmp_path = '%s.%d' % (path, os.getpid())
+    with open(tmp_path, 'w') as f:
+      json.dump(data, f)
+    os.rename(tmp_path, path)
+  except (IOError, OSError):
+    pass
+
+class ModuleIndex:
+  """Maps module file names (vmlinux, foo.ko) to their paths in the kernel
+  tree. The tree is walked once and the result is cached in cache_dir."""
+
+  def __init__(self, linux_path, cache_dir):
+    self.linux_path = os.path.abspath(linux_path)
+    self.cache_path = None
+    if cache_dir:
+      self.cache_path = os.path.join(cache_dir, 'modules-%s.json' %
+          hashlib.md5(self.linux_path).hexdigest())
+    self.rescanned = False
+    self.paths = LoadJson(self.cache_path) if self.cache_path else None
+    if self.paths is None:
+      self.Rescan()
+
+  def Rescan(self):
+    self.paths = {}
+    for root, dirs, files in os.walk(self.linux_path):
+      for name in files:
+        if name == 'vmlinux' or name.endswith('.ko'):
+          # Like the old FindFile, prefer the first match of os.walk.
+          self.paths.setdefault(name, os.path.join(root, name))
+    self.rescanned = True
+    if self.cache_path:
+      SaveJson(self.cache_path, self.paths)
+
+  def Lookup(self, name):
+    path = self.paths.get(name)
+    if path is None or not os.path.exists(path):
+      # The cache may predate a rebuild, refresh it once per run.
+      if self.rescanned:
+        return None
+      self.Rescan()
+      path = self.paths.get(name)
+    return path
+
+def ReadBuildId(binary_path):
+  output = subprocess.check_output(['readelf', '-n', binary_path])
+  match = build_id_re.search(output)
+  if match == None:
+    return None
+  return match.group('build_id')
 
 class SymbolOffsetLoader:
-  def __init__(self, binary_path):
+  def __init__(self, binary_path, cache_dir):
+    cache_path = None
+    if cache_dir:
+      build_id = ReadBuildId(binary_path)
+      if build_id != None:
+        cache_path = os.path.join(cache_dir, 'nm', build_id + '.json')
+        self.offsets = LoadJson(cache_path)
+        if self.offsets is not None:
+          return
+
     output = subprocess.check_output(['nm', binary_path])
     self.offsets = {}
     for line in output.split('\n'):
       match = nm_re.match(line)
       if match != None:
         self.offsets[match.group('symbol')] = int(match.group('offset'), 16)
+    if cache_path:
+      SaveJson(cache_path, self.offsets)
 
   def LookupOffset(self, symbol):
     return self.offsets.get(symbol)
 
 class ReportProcesser:
-  def __init__(self, linux_path, strip_path):
+  def __init__(self, linux_path, strip_path, cache_dir):
     self.strip_path = strip_path
-    self.linux_path = linux_path
+    self.cache_dir = cache_dir
+    self.module_index = ModuleIndex(linux_path, cache_dir)
     self.module_symbolizers = {}
     self.module_offset_loaders = {}
+    self.pool = ThreadPool(8)
+    self.lines = []
+    # (module, address) -> frames, the same stacks repeat all over a log.
+    self.frame_cache = {}
 
   def ProcessInput(self):
     for line in sys.stdin:
       line = line.rstrip()
       line = self.StripTime(line)
-      self.ProcessLine(line)
+      self.lines.append(line)
+      if (report_separator_re.match(line) or
+          len(self.lines) >= MAX_BATCH_LINES):
+        self.ProcessLines()
+    self.ProcessLines()
 
   def StripTime(self, line):
     match = time_re.match(line)
@@ -97,63 +209,67 @@ class ReportProcesser:
       line = match.group('suffix')
     return line
 
-  def ProcessLine(self, line):
-    match = frame_re.match(line)
-    if match == None:
-      print line
-      return
-
-    addr = match.group('addr')
-    suffix = match.group('suffix')
-
-    function = match.group('function')
-    offset = match.group('offset')
-    size = match.group('size')
+  # Symbolizes and prints the buffered lines, with at most one symbolizer
+  # request per module.
+  def ProcessLines(self):
+    lines, self.lines = self.lines, []
+    matches = [frame_re.match(line) for line in lines]
+    modules = set(self.ModuleName(match) for match in matches if match)
+    self.LoadModules(modules)
+
+    requests = {}
+    keys = {}
+    for i, match in enumerate(matches):
+      if match == None:
+        continue
+      module = self.ModuleName(match)
+      loader = self.module_offset_loaders.get(module)
+      if loader == None:
+        continue
+      symbol_offset = loader.LookupOffset(match.group('function'))
+      if symbol_offset == None:
+        continue
+      instruction_offset = int(match.group('offset'), 16)
+      module_addr = '%x' % (symbol_offset + instruction_offset - 1)
+      keys[i] = (module, module_addr)
+      if keys[i] not in self.frame_cache:
+        requests.setdefault(module, set()).add(module_addr)
+
+    for module, addrs in requests.items():
+      addrs = list(addrs)
+      results = self.module_symbolizers[module].ProcessBatch(addrs)
+      for addr, result in zip(addrs, results):
+        self.frame_cache[(module, addr)] = result
+
+    frames = dict((i, self.frame_cache[key]) for i, key in keys.items())
+    for i, line in enumerate(lines):
+      if not frames.get(i):
+        print line
+        continue
+      addr = matches[i].group('addr')
+      suffix = matches[i].group('suffix')
+      for frame in frames[i][:-1]:
+        self.PrintInlinedFrame(addr, frame[0], frame[1], suffix)
+      self.PrintFrame(addr, frames[i][-1][0], frames[i][-1][1], suffix)
+
+  def ModuleName(self, match):
     module = match.group('module')
-
     if module == None:
-      module = 'vmlinux'
-    else:
-      module += '.ko'
-
-    frames = []
-
-    if not self.LoadModule(module):
-      print line
-      return
-
-    symbolizer = self.module_symbolizers[module]
-    loader = self.module_offset_loaders[module]
-
-    symbol_offset = loader.LookupOffset(function)
-    if not symbol_offset:
-      print line
-      return
-
-    instruction_offset = int(offset, 16)
-    module_addr = hex(symbol_offset + instruction_offset - 1);
-
-    frames = symbolizer.Process(module_addr)
-
-    if len(frames) == 0:
-      print line
-      return
-
-    for frame in frames[:-1]:
-      self.PrintInlinedFrame(addr, frame[0], frame[1], suffix)
-    self.PrintFrame(addr, frames[-1][0], frames[-1][1], suffix)
-
-  def LoadModule(self, module):
-    if module in self.module_symbolizers.keys():
-      return True
-
-    module_path = FindFile(self.linux_path, module)
-    if module_path == None:
-      return False
-
-    self.module_symbolizers[module] = Symbolizer(module_path)
-    self.module_offset_loaders[module] = SymbolOffsetLoader(module_path)
-    return True
+      return 'vmlinux'
+    return module + '.ko'
+
+  # Starts the symbolizers of all modules that aren't loaded yet in parallel.
+  def LoadModules(self, modules):
+    new_modules = [module for module in modules
+                   if module not in self.module_symbolizers]
+    paths = [self.module_index.Lookup(module) for module in new_modules]
+    def Load(path):
+      if path == None:
+        return None
+      return (Symbolizer(path), SymbolOffsetLoader(path, self.cache_dir))
+    for module, loaded in zip(new_modules, self.pool.map(Load, paths)):
+      self.module_symbolizers[module] = loaded and loaded[0]
+      self.module_offset_loaders[module] = loaded and loaded[1]
 
   def PrintFrame(self, addr, func, fileline, suffix):
     if self.strip_path != None:
@@ -172,15 +288,22 @@ class ReportProcesser:
 
   def Finalize(self):
     for module, symbolizer in self.module_symbolizers.items():
-      symbolizer.Close()
+      if symbolizer:
+        symbolizer.Close()
+    self.pool.close()
 
 def main():
   if len(sys.argv) not in [2, 3]:
     print_usage()
     sys.exit(1)
+  native_symbolizer = os.environ.get('KASAN_SYMBOLIZER')
+  if native_symbolizer:
+    os.execv(native_symbolizer, [native_symbolizer] + sys.argv[1:])
   linux_path = sys.argv[1]
   strip_path = sys.argv[2] if len(sys.argv) == 3 else None
-  processer = ReportProcesser(linux_path, strip_path)
+  cache_dir = os.environ.get('KASAN_SYMBOLIZE_CACHE',
+                             os.path.expanduser('~/.cache/kasan_symbolize'))
+  processer = ReportProcesser(linux_path, strip_path, cache_dir)
   processer.ProcessInput()
   processer.Finalize()
   sys.exit(0)
@@ -7,8 +7,14 @@ Each test should write special messages to kernel log:
 ##### FAIL <reason> denotes the test failed
 ##### ASSERT '<regex>' - we should search for the regex in other lines of the
     test's output. If it's not found, the test fails
+
+The log is parsed in one pass. The asserts of the running test are checked
+against every line as it arrives, and against the lines kept before the
+assert showed up. Only the last --max_test_lines lines of each test are kept,
+and only failed runs keep them until the report is printed.
 """
 
+import collections
 import re
 import sys
 import difflib
@@ -19,6 +25,9 @@ TEST_END_RE = re.compile(r"##### TEST_END (.*)$")
 ASSERT_RE = re.compile(r"##### ASSERT '(.*)'")
 FAIL_RE = re.compile(r"##### FAIL (.*)$")
 
+# All the markers start with this, so most lines are rejected with one search.
+MARKER = "##### "
+
 parser = argparse.ArgumentParser(
     description = "Parser for unit kernel test logs from input",
     usage = "dmesg | test_parse.py [options]")
@@ -33,58 +42,152 @@ parser.add_argument("--annotate", action = "store_true",
                     help = "special output for buildbot annotator")
 parser.add_argument("--allow_flaky", nargs = '*', metavar = "name",
                     help = "allow the listed tests to be flaky")
+parser.add_argument("--max_test_lines", type = int, metavar = "N",
+                    default = 20000,
+                    help = "keep at most the last N lines of each test run")
 args = parser.parse_args()
 
-def ExtractTestLogs(kernel_log):
-  all_tests = []
-  current_test_lines = []
-  current_test = None
+class AssertMatcher:
+  """The pending asserts of a test run. Plain patterns are or-ed into one
+  regex, so a line that matches none of them costs a single search. Patterns
+  with groups or inline flags would change meaning inside the combined regex
+  and are searched on their own."""
 
-  for line in sys.stdin:
-    l = line.strip()
-    if current_test:
-      if TEST_END_RE.search(l):
-        all_tests.append((current_test, current_test_lines))
-        current_test = None
-        current_test_lines = []
+  def __init__(self):
+    self.pending = collections.OrderedDict()
+    self.combined = None
+    self.separate = []
+
+  def Add(self, pattern, compiled):
+    self.pending[pattern] = compiled
+    self.Rebuild()
+
+  def Rebuild(self):
+    plain = []
+    self.separate = []
+    for pattern, compiled in self.pending.iteritems():
+      if compiled.groups or "(?" in pattern:
+        self.separate.append(pattern)
       else:
-        current_test_lines.append(l)
+        plain.append(pattern)
+    self.combined = None
+    if plain:
+      self.combined = re.compile("|".join("(?:%s)" % p for p in plain))
+
+  # Drops the asserts satisfied by line.
+  def Check(self, line):
+    if self.combined and self.combined.search(line):
+      matched = [p for p, c in self.pending.iteritems() if c.search(line)]
     else:
+      matched = [p for p in self.separate if self.pending[p].search(line)]
+    if matched:
+      for p in matched:
+        del self.pending[p]
+      self.Rebuild()
+
+class TestRun:
+  def __init__(self, name):
+    self.name = name
+    self.lines = collections.deque(maxlen = args.max_test_lines)
+    self.dropped_lines = 0
+    self.failures = []
+    # Patterns in the order the asserts appeared.
+    self.asserts = []
+    self.matcher = AssertMatcher()
+
+  def AddLine(self, l):
+    if MARKER in l:
+      m = ASSERT_RE.search(l)
+      if m:
+        self.AddAssert(m.group(1))
+        self.Keep(l)
+        return
+      m = FAIL_RE.search(l)
+      if m:
+        self.failures.append(m.group(1))
+    if self.matcher.pending:
+      self.matcher.Check(l)
+    self.Keep(l)
+
+  def Keep(self, l):
+    if len(self.lines) == self.lines.maxlen:
+      self.dropped_lines += 1
+    self.lines.append(l)
+
+  def AddAssert(self, pattern):
+    self.asserts.append(pattern)
+    if pattern in self.matcher.pending:
+      return
+    compiled = re.compile(pattern)
+    # The assert may refer to output printed before it.
+    for l in self.lines:
+      if compiled.search(l) and not ASSERT_RE.search(l):
+        return
+    self.matcher.Add(pattern, compiled)
+
+  def FailedAsserts(self):
+    return [a for a in self.asserts if a in self.matcher.pending]
+
+  def Passed(self):
+    return not self.failures and not self.matcher.pending
+
+class LineIndex:
+  """Trigram index over the kept lines of a failed run, used to find the
+  lines closest to the failed asserts without comparing them to every line.
+  Only the trigrams of the asserts are indexed, and they are looked up with
+  a single regex per line."""
+
+  # Only the best-scoring lines by shared trigrams are ranked with difflib.
+  SHORTLIST = 50
+
+  def __init__(self, lines, patterns):
+    self.lines = [l for l in lines if not ASSERT_RE.search(l)]
+    self.index = {}
+    grams = set()
+    for pattern in patterns:
+      grams |= self.Trigrams(pattern)
+    if not grams:
+      return
+    # The lookahead finds overlapping trigrams.
+    gram_re = re.compile("(?=(%s))" % "|".join(re.escape(g) for g in grams))
+    for i, l in enumerate(self.lines):
+      for gram in set(gram_re.findall(l)):
+        self.index.setdefault(gram, []).append(i)
+
+  def Trigrams(self, s):
+    return set(s[i:i + 3] for i in xrange(len(s) - 2))
+
+  def ClosestMatches(self, pattern, n, cutoff):
+    scores = collections.Counter()
+    for gram in self.Trigrams(pattern):
+      # Trigrams present on most of the lines don't tell them apart.
+      postings = self.index.get(gram, ())
+      if len(postings) * 2 > len(self.lines) and len(self.lines) > self.SHORTLIST:
+        continue
+      scores.update(postings)
+    shortlist = [self.lines[i] for i, _ in scores.most_common(self.SHORTLIST)]
+    return difflib.get_close_matches(pattern, shortlist, n, cutoff)
+
+def ExtractTestRuns(kernel_log):
+  current = None
+  for line in kernel_log:
+    l = line.strip()
+    if current:
+      if MARKER in l and TEST_END_RE.search(l):
+        yield current
+        current = None
+      else:
+        current.AddLine(l)
+    elif MARKER in l:
       m = TEST_START_RE.search(l)
       if m:
-        current_test = m.group(1)
-  return all_tests
-
-def FindFailures(lines):
-  failures = []
-  for l in lines:
-    m = FAIL_RE.search(l)
-    if m:
-      failures.append(m.group(1))
-  return failures
-
-def FindAssertFailures(lines):
-  failed_asserts = []
-  for l in lines:
-    m = ASSERT_RE.search(l)
-    if m:
-      current_assert_re = re.compile(m.group(1))
-      has_matches = False
-      for checkedline in lines:
-        if ASSERT_RE.search(checkedline):
-          continue
-        if current_assert_re.search(checkedline):
-          has_matches = True
-          break
-      if not has_matches:
-        failed_asserts.append(current_assert_re.pattern)
-  return failed_asserts
+        current = TestRun(m.group(1))
 
 def PrintTestReport(test, run_reports):
   passed = 0
   failed = 0
-  for result, _, _, _ in run_reports:
-    if result:
+  for run in run_reports:
+    if run.Passed():
       passed += 1
     else:
       failed += 1
@@ -99,26 +202,32 @@ def PrintTestReport(test, run_reports):
   print "TEST %s: %s" % (test, total_result)  
   if args.brief:
     return
-  for index, (_, failures, failed_asserts, lines) in enumerate(run_reports):
-    if not failures and not failed_asserts:
+  for index, run in enumerate(run_reports):
+    if run.Passed():
       continue
+    failures = run.failures
+    failed_asserts = run.FailedAsserts()
     print "  Run %d"   % index
     for f in failures:
-      print "    Failed: %s" % s
+      print "    Failed: %s" % f
     missing_matches = not args.assert_candidates
+    line_index = None
+    if failed_asserts and args.assert_candidates:
+      line_index = LineIndex(run.lines, failed_asserts)
     for a in failed_asserts:
       print "    Failed assert: %s" % a
       if args.assert_candidates:
         print "    Closest matches:"
-        matches =  difflib.get_close_matches(a, lines, args.assert_candidates, 0.4)
-        matches = [match for match in matches if not ASSERT_RE.search(match)]
+        matches = line_index.ClosestMatches(a, args.assert_candidates, 0.4)
         for match in matches:
           print "    " + match
         if not matches:
           missing_matches = True
     if args.failed_log and (failures or missing_matches):
       print "    Test log:"
-      for l in lines:
+      if run.dropped_lines:
+        print "        (%d earlier lines dropped)" % run.dropped_lines
+      for l in run.lines:
         print "        " + l
 
 def PrintBuildBotAnnotation(passed, failed, flaky, flaky_not_allowed):
@@ -129,34 +238,25 @@ def PrintBuildBotAnnotation(passed, failed, flaky, flaky_not_allowed):
   if failed or flaky_not_allowed:
     print "@@@STEP_FAILURE@@@"
 
-def GroupTests(tests):
-  result = {}
-  for test, lines in tests:
-    if test not in result:
-      result[test] = []
-    result[test].append(lines)
-  return result  
+def GroupTests(runs):
+  result = collections.OrderedDict()
+  for run in runs:
+    if run.Passed():
+      # Nothing of a passed run gets printed, don't hold on to its log.
+      run.lines.clear()
+    result.setdefault(run.name, []).append(run)
+  return result
 
 def main():
-  all_tests = ExtractTestLogs(sys.stdin)
-  grouped_tests = GroupTests(all_tests)
+  grouped_tests = GroupTests(ExtractTestRuns(sys.stdin))
 
   total_passed = 0
   total_failed = 0
   total_flaky = 0
   flaky_not_allowed = False
   for test, runs in grouped_tests.iteritems():
-    passed = 0
-    failed = 0
-    run_reports = []
-    for lines in runs:
-      failed_asserts = FindAssertFailures(lines)
-      failures = FindFailures(lines)
-      if failed_asserts or failures:
-        failed += 1
-      else:
-        passed += 1
-      run_reports.append((not failed_asserts and not failures, failures, failed_asserts, lines))
+    passed = len([run for run in runs if run.Passed()])
+    failed = len(runs) - passed
     if passed and not failed:
       total_passed += 1
     elif failed and not passed:
@@ -165,7 +265,7 @@ def main():
       total_flaky += 1
       if not args.allow_flaky or (test not in args.allow_flaky):
 	flaky_not_allowed = True
-    PrintTestReport(test, run_reports)
+    PrintTestReport(test, runs)
 
   if args.annotate:
     PrintBuildBotAnnotation(total_passed, total_failed, total_flaky, flaky_not_allowed)